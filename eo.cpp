@@ -10,9 +10,53 @@
 #include <unistd.h>     // POSIX API: Provides access to POSIX system calls (e.g., sleep, getpid) for Unix-like systems
 #include <cstdlib>      // C Standard Library: Includes functions for general utilities (e.g., rand, exit, atoi)
 #include <sys/ioctl.h>  // System I/O Control: Provides access to terminal size information
+#include <iomanip>      // I/O Manipulators: Fixed-width hex and number formatting
+#include <cmath>        // Math Library: log2 for byte entropy
+#include <cstring>      // C String Library: Provides memchr/memcpy for fast byte scanning
+#include <string_view>  // String View: Non-owning views into the input buffer
+#include <array>        // Fixed-size Arrays: Lookup tables for byte classification
+#include <memory_resource> // Polymorphic Allocators: Per-run monotonic arena for parse/format containers
+#include <unordered_map> // Hash Maps: Key interning for the compact JSON tape
+#include <thread>       // Threads: Worker threads for parallel parsing
+#include <functional>   // Function Wrappers: Callbacks between parsing stages
+#include <charconv>     // Character Conversion: Locale-free number parsing of table cells
+#include <atomic>       // Atomics: Round-robin task placement in the scheduler
+#include <sched.h>      // Scheduling: CPU affinity mask for the default job count
+#if defined(__SSE2__)
+#include <emmintrin.h>  // SSE2 Intrinsics: 16-byte vector compares for ASCII/byte scanning fast paths
+#endif
+#include <sys/stat.h>   // File Status: Sizes regular-file stdin up front
+#include <cerrno>       // Error Numbers: errno for failed reads
+#include <memory>       // Smart Pointers: Owning handles for decompression contexts
+#include <mutex>        // Mutexes: Hand-off between the stdin reader thread and its consumer
+#include <condition_variable> // Condition Variables: Bounded chunk queue between reader and consumer
+#include <deque>        // Double-ended Queue: Chunks read ahead of the consumer
+#include <coroutine>    // Coroutines: Pipeline stages suspended and resumed on a small executor
+#include <optional>     // Optional Values: Coroutine results not yet produced
+#include <ctime>        // C Time: Current year for syslog timestamps, which omit it
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h> // io_uring: Asynchronous stdin reads and batched stdout writes
+#include <sys/syscall.h> // System Calls: io_uring_setup/io_uring_enter without liburing
+#include <sys/mman.h>   // Memory Mapping: io_uring submission and completion rings
+#if defined(IORING_FEAT_RW_CUR_POS)
+#define EO_HAVE_IO_URING 1
+#endif
+#endif
+#if __has_include(<zlib.h>)
+#include <zlib.h>       // zlib: gzip/BGZF decompression of piped input (link with -lz)
+#define EO_HAVE_ZLIB 1
+#endif
+#if __has_include(<zstd.h>)
+#include <zstd.h>       // Zstandard: zstd decompression of piped input (link with -lzstd)
+#define EO_HAVE_ZSTD 1
+#endif
+#if __has_include(<lzma.h>)
+#include <lzma.h>       // liblzma: xz decompression of piped input (link with -llzma)
+#define EO_HAVE_LZMA 1
+#endif
 
 // Define an enumeration for supported input formats
-enum class Format { JSON, TABLE, PLAIN_TEXT };
+enum class Format { JSON, YAML, TABLE, PLAIN_TEXT };
 
 /**
  * @brief Retrieves the current terminal width in characters.
@@ -34,147 +78,5018 @@ void display_help() {
               << "\n"
               << "eo enhances command-line output by analyzing and formatting it using an AI model.\n"
               << "The program accepts output from another command via a pipe, detects its format\n"
-              << "(JSON, table, or plain text), and provides a formatted and AI-enhanced version.\n"
+              << "(JSON, YAML, table, or plain text), and provides a formatted and AI-enhanced version.\n"
               << "\n"
               << "Options:\n"
               << "  -h, --help        Display this help message and exit.\n"
+              << "  -i, --interactive Ask follow-up questions about the input after the first answer\n"
+              << "                    (reads questions from the terminal; \"exit\" or Ctrl-D to quit).\n"
               << "  --url=<URL>       Set the Ollama service URL (e.g., --url=http://localhost:11434).\n"
               << "                    The URL is saved to /etc/eo/config.txt for future use.\n"
+              << "  --ai              Also ask the model for output that a built-in analyzer already\n"
+              << "                    handles (df, free, ps aux, docker ps, kubectl get pods,\n"
+              << "                    systemctl list-units); by default those are checked locally only.\n"
+              << "  --model=<NAME>    Use this model for every request instead of the default cascade\n"
+              << "                    (smallest installed model first, largest when the input is\n"
+              << "                    complex or the small model reports low confidence).\n"
+              << "  --select=<PATH>   Only format and analyze part of a JSON/YAML document, using a\n"
+              << "                    jq-style path (e.g., --select=.items[].status, .data[\"key\"], .[0]).\n"
+              << "  --sort=<COL>      Sort table rows by a column (header name or 1-based index), by\n"
+              << "                    value for numeric, size, duration and time columns; --sort=-COL\n"
+              << "                    sorts descending. Applies to the local table and the prompt.\n"
+              << "  --top=<N>         Keep only the first N table rows (after --sort).\n"
+              << "  --group-by=<COL>  Group table rows by a column and show one row per value.\n"
+              << "  --agg=<LIST>      Aggregates per group: count, sum(COL), avg(COL), min(COL), max(COL)\n"
+              << "                    (default: count). Groups are ordered by size; sort with --sort.\n"
+              << "  --normalize-units Show each size column of a table in one unit (e.g., 0.5G, 1.2G).\n"
+              << "  --jobs=<N>        Number of CPU threads for parallel parsing and decompression\n"
+              << "                    (default: available CPUs, honoring container CPU quotas).\n"
+              << "  --think-budget=<N> If a reasoning model still thinks for more than N tokens,\n"
+              << "                    abort and re-request with thinking disabled.\n"
               << "\n"
               << "Examples:\n"
               << "  echo '{\"key\": \"value\"}' | eo\n"
               << "  ls -l | eo\n"
+              << "  kubectl get pods -o yaml | eo\n"
+              << "  kubectl get pods -o json | eo --select=.items[].status\n"
+              << "  kubectl get pods | eo -i\n"
+              << "  ps aux | eo --sort=-%CPU --top=10\n"
+              << "  kubectl get pods -A | eo --group-by=STATUS --agg=count,sum(RESTARTS)\n"
               << "  eo --url=http://example.com:11434\n"
               << "\n"
               << "Notes:\n"
               << "  - The default URL is http://localhost:11434 if not specified or saved in /etc/eo/config.txt.\n"
               << "  - The program uses ANSI escape codes for colored and bold output in the terminal.\n"
-              << "  - Supported input formats: JSON, table (space-separated), and plain text.\n";
+              << "  - gzip, zstd and xz input is decompressed automatically.\n"
+              << "  - Binary input (archives, images, core dumps) is summarized locally with a hexdump.\n"
+              << "  - ANSI escape codes in the input (e.g., ls --color) are stripped before analysis;\n"
+              << "    original colors are kept when tables are rendered locally.\n"
+              << "  - Supported input formats: JSON, YAML (including multi-document streams),\n"
+              << "    table (space-separated), and plain text.\n";
 }
 
+/**
+ * @brief Number of CPUs this process may actually use.
+ *
+ * The smaller of the affinity mask and the cgroup CPU quota (cgroup v2
+ * `cpu.max`, or v1 `cpu.cfs_quota_us`/`cpu.cfs_period_us`), so a container
+ * limited to 2 CPUs on a 64-core host does not oversubscribe.
+ * @return At least 1.
+ */
+size_t available_cpus() {
+    size_t cpus = std::max(1u, std::thread::hardware_concurrency());
+#if defined(__linux__)
+    cpu_set_t set;
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) cpus = std::max(1, CPU_COUNT(&set));
+
+    auto apply_quota = [&](double quota, double period) {
+        if (quota > 0 && period > 0) cpus = std::min(cpus, std::max<size_t>(1, static_cast<size_t>(std::ceil(quota / period))));
+    };
+    // cgroup v2: the process's own group, then the namespace root
+    std::string group;
+    std::ifstream self("/proc/self/cgroup");
+    for (std::string line; std::getline(self, line);) {
+        if (line.rfind("0::", 0) == 0) group = line.substr(3);
+    }
+    for (const std::string& path : {"/sys/fs/cgroup" + group + "/cpu.max", std::string("/sys/fs/cgroup/cpu.max")}) {
+        std::ifstream f(path);
+        std::string quota;
+        double period = 0;
+        if (f >> quota >> period) {
+            if (quota != "max") apply_quota(std::atof(quota.c_str()), period);
+            return cpus;
+        }
+    }
+    // cgroup v1
+    for (const char* dir : {"/sys/fs/cgroup/cpu", "/sys/fs/cgroup/cpu,cpuacct"}) {
+        std::ifstream q(std::string(dir) + "/cpu.cfs_quota_us"), p(std::string(dir) + "/cpu.cfs_period_us");
+        double quota = 0, period = 0;
+        if (q >> quota && p >> period) {
+            apply_quota(quota, period);
+            break;
+        }
+    }
+#endif
+    return cpus;
+}
+
+/**
+ * @brief Work-stealing scheduler shared by every CPU-bound stage.
+ *
+ * Each worker owns a deque: it pops its own newest task and, when empty,
+ * steals the oldest task of another worker. Threads that wait for a batch
+ * (including workers running nested batches) execute queued tasks while
+ * they wait, so nesting cannot deadlock and no stage spawns its own threads.
+ * A scheduler for N jobs starts N-1 workers; the waiting caller is the Nth.
+ */
+class Scheduler {
+public:
+    explicit Scheduler(size_t jobs) {
+        jobs = std::max<size_t>(1, jobs);
+        for (size_t i = 0; i < jobs - 1; ++i) queues_.push_back(std::make_unique<Queue>());
+        for (size_t i = 0; i < jobs - 1; ++i) workers_.emplace_back([this, i]() { work(i); });
+    }
+
+    ~Scheduler() {
+        {
+            std::lock_guard<std::mutex> lock(sleep_mutex_);
+            stopping_ = true;
+        }
+        sleep_cv_.notify_all();
+        for (auto& w : workers_) w.join();
+    }
+
+    Scheduler(const Scheduler&) = delete;
+    Scheduler& operator=(const Scheduler&) = delete;
+
+    /**
+     * @brief The process-wide scheduler, created on first use.
+     * @param jobs Parallelism for the first call (`--jobs`); 0 means available_cpus().
+     */
+    static Scheduler& global(size_t jobs = 0) {
+        static Scheduler instance(jobs ? jobs : available_cpus());
+        return instance;
+    }
+
+    /** @brief Total parallelism, counting the waiting caller. */
+    size_t jobs() const { return workers_.size() + 1; }
+
+    /**
+     * @brief Runs fn(0..count-1) in parallel and waits for all of them.
+     * @param count Number of tasks.
+     * @param fn Callable invoked with each task index; the first exception thrown is rethrown.
+     */
+    template <typename F>
+    void parallel_for(size_t count, F&& fn) {
+        ordered(count, [&](size_t i) { fn(i); return true; }, [](size_t, bool) {});
+    }
+
+    /**
+     * @brief Runs produce(0..count-1) in parallel and hands the results to consume in index order.
+     *
+     * consume runs on the calling thread as soon as the next result in order is
+     * ready, while later results are still being produced, so stages whose
+     * output must keep input order (decompressed blocks, rendered rows) stream
+     * instead of waiting for the whole batch.
+     * @param count Number of tasks.
+     * @param produce Callable returning the result for an index.
+     * @param consume Callable taking (index, result), called in increasing index order.
+     */
+    template <typename Produce, typename Consume>
+    void ordered(size_t count, Produce&& produce, Consume&& consume) {
+        using Result = std::invoke_result_t<Produce&, size_t>;
+        if (count == 0) return;
+        if (workers_.empty() || count == 1) {
+            for (size_t i = 0; i < count; ++i) consume(i, produce(i));
+            return;
+        }
+        struct Batch {
+            std::mutex mutex;
+            std::condition_variable cv;
+            std::vector<std::optional<Result>> results;
+            size_t remaining;
+            std::exception_ptr error;
+        } batch;
+        batch.results.resize(count);
+        batch.remaining = count;
+        for (size_t i = 0; i < count; ++i) {
+            submit([&batch, &produce, i]() {
+                std::optional<Result> result;
+                std::exception_ptr error;
+                try {
+                    result.emplace(produce(i));
+                } catch (...) {
+                    error = std::current_exception();
+                }
+                std::lock_guard<std::mutex> lock(batch.mutex);
+                batch.results[i] = std::move(result);
+                if (error && !batch.error) batch.error = error;
+                --batch.remaining;
+                batch.cv.notify_all();
+            });
+        }
+        std::exception_ptr consume_error;
+        for (size_t next = 0; next < count && !consume_error; ++next) {
+            wait_until(batch.mutex, batch.cv, [&] { return batch.results[next].has_value() || batch.error; });
+            if (!batch.results[next]) break;
+            try {
+                consume(next, std::move(*batch.results[next]));
+            } catch (...) {
+                consume_error = std::current_exception();
+            }
+            batch.results[next].reset();
+        }
+        // Tasks reference this frame; let every one of them finish before unwinding
+        wait_until(batch.mutex, batch.cv, [&] { return batch.remaining == 0; });
+        if (batch.error) std::rethrow_exception(batch.error);
+        if (consume_error) std::rethrow_exception(consume_error);
+    }
+
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    static thread_local Scheduler* current_;
+    static thread_local size_t current_index_;
+
+    void submit(std::function<void()> task) {
+        // Workers push to their own deque (nested batches stay local); other threads spread round-robin
+        // Count the task before publishing it so a thief can never decrement first
+        size_t index = current_ == this ? current_index_ : next_queue_++ % queues_.size();
+        {
+            std::lock_guard<std::mutex> lock(sleep_mutex_);
+            ++pending_;
+        }
+        {
+            std::lock_guard<std::mutex> lock(queues_[index]->mutex);
+            queues_[index]->tasks.push_back(std::move(task));
+        }
+        sleep_cv_.notify_one();
+    }
+
+    /**
+     * @brief Runs one queued task: the newest of the caller's own deque, else the oldest stolen from another.
+     * @return False if every deque was empty.
+     */
+    bool run_one() {
+        std::function<void()> task;
+        size_t own = current_ == this ? current_index_ : SIZE_MAX;
+        if (own != SIZE_MAX) {
+            std::lock_guard<std::mutex> lock(queues_[own]->mutex);
+            if (!queues_[own]->tasks.empty()) {
+                task = std::move(queues_[own]->tasks.back());
+                queues_[own]->tasks.pop_back();
+            }
+        }
+        for (size_t k = 0; !task && k < queues_.size(); ++k) {
+            size_t victim = (own == SIZE_MAX ? k : own + 1 + k) % queues_.size();
+            if (victim == own) continue;
+            std::lock_guard<std::mutex> lock(queues_[victim]->mutex);
+            if (!queues_[victim]->tasks.empty()) {
+                task = std::move(queues_[victim]->tasks.front());
+                queues_[victim]->tasks.pop_front();
+            }
+        }
+        if (!task) return false;
+        {
+            std::lock_guard<std::mutex> lock(sleep_mutex_);
+            --pending_;
+        }
+        task();
+        return true;
+    }
+
+    /**
+     * @brief Waits for a batch condition, running queued tasks in the meantime.
+     */
+    template <typename Done>
+    void wait_until(std::mutex& mutex, std::condition_variable& cv, Done done) {
+        while (true) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (done()) return;
+            }
+            if (run_one()) continue;
+            // Nothing runnable: the remaining tasks of this batch are executing elsewhere
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, done);
+            return;
+        }
+    }
+
+    void work(size_t index) {
+        current_ = this;
+        current_index_ = index;
+        while (true) {
+            if (run_one()) continue;
+            std::unique_lock<std::mutex> lock(sleep_mutex_);
+            sleep_cv_.wait(lock, [&] { return stopping_ || pending_ > 0; });
+            if (stopping_) return;
+        }
+    }
+
+    std::vector<std::unique_ptr<Queue>> queues_;
+    std::vector<std::thread> workers_;
+    std::mutex sleep_mutex_;
+    std::condition_variable sleep_cv_;
+    size_t pending_ = 0;
+    std::atomic<size_t> next_queue_{0};
+    bool stopping_ = false;
+};
+
+thread_local Scheduler* Scheduler::current_ = nullptr;
+thread_local size_t Scheduler::current_index_ = 0;
+
+/**
+ * @brief Appends up to one chunk from a file descriptor to a buffer.
+ * @param fd The descriptor to read from.
+ * @param buffer The buffer to append to.
+ * @param chunk The maximum number of bytes to read.
+ * @return False once the descriptor reaches end of file.
+ */
+bool read_chunk(int fd, std::string& buffer, size_t chunk = 1 << 20) {
+    size_t old_size = buffer.size();
+    buffer.resize(old_size + chunk);
+    ssize_t n;
+    do {
+        n = read(fd, &buffer[old_size], chunk);
+    } while (n < 0 && errno == EINTR);
+    if (n < 0) {
+        buffer.resize(old_size);
+        throw std::runtime_error(std::string("Failed to read input: ") + std::strerror(errno));
+    }
+    buffer.resize(old_size + n);
+    return n > 0;
+}
+
+/**
+ * @brief Minimal io_uring instance driven through raw system calls.
+ *
+ * Only what the stdin reader and stdout writer need: queue SQEs, submit and
+ * wait, and reap CQEs. valid() is false when the kernel lacks io_uring or it
+ * is disabled (containers, seccomp), and callers fall back to read()/write().
+ */
+class IoUring {
+public:
+    explicit IoUring(unsigned entries) {
+#if EO_HAVE_IO_URING
+        io_uring_params params{};
+        fd_ = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+        if (fd_ < 0) return;
+        if (!(params.features & IORING_FEAT_RW_CUR_POS)) {
+            // Kernels before 5.6 cannot read/write at the current position (pipes)
+            release();
+            return;
+        }
+        sq_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cq_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        single_mmap_ = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (single_mmap_) sq_size_ = cq_size_ = std::max(sq_size_, cq_size_);
+        sq_ring_ = mmap(nullptr, sq_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+        cq_ring_ = single_mmap_ ? sq_ring_ : mmap(nullptr, cq_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_CQ_RING);
+        sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+        sqes_ = static_cast<io_uring_sqe*>(mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES));
+        if (sq_ring_ == MAP_FAILED || cq_ring_ == MAP_FAILED || sqes_ == MAP_FAILED) {
+            release();
+            return;
+        }
+        char* sq = static_cast<char*>(sq_ring_);
+        char* cq = static_cast<char*>(cq_ring_);
+        sq_tail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sq_mask_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sq_array_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        cq_head_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cq_tail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cq_mask_ = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+        valid_ = true;
+#else
+        (void)entries;
+#endif
+    }
+    ~IoUring() { release(); }
+    IoUring(const IoUring&) = delete;
+    IoUring& operator=(const IoUring&) = delete;
+
+    bool valid() const { return valid_; }
+
+#if EO_HAVE_IO_URING
+    /**
+     * @brief Queues a read or write; offset -1 uses (and advances) the file position.
+     * @param link Run the next queued operation only after this one completes in full.
+     */
+    void queue(uint8_t opcode, int fd, void* buf, size_t len, uint64_t offset, uint64_t tag, bool link = false) {
+        unsigned tail = *sq_tail_;
+        unsigned index = tail & sq_mask_;
+        io_uring_sqe& sqe = sqes_[index];
+        std::memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = opcode;
+        sqe.fd = fd;
+        sqe.addr = reinterpret_cast<uint64_t>(buf);
+        sqe.len = static_cast<unsigned>(len);
+        sqe.off = offset;
+        sqe.user_data = tag;
+        if (link) sqe.flags = IOSQE_IO_LINK;
+        sq_array_[index] = index;
+        __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+        ++pending_;
+    }
+
+    /**
+     * @brief Submits queued operations and waits for at least one completion.
+     * @return False if the kernel rejected the submission.
+     */
+    bool submit_and_wait() {
+        int ret;
+        do {
+            ret = static_cast<int>(syscall(__NR_io_uring_enter, fd_, pending_, 1, IORING_ENTER_GETEVENTS, nullptr, 0));
+        } while (ret < 0 && errno == EINTR);
+        if (ret < 0) return false;
+        pending_ -= std::min<unsigned>(pending_, ret);
+        return true;
+    }
+
+    /**
+     * @brief Waits for at least one completion without submitting anything.
+     * @return False if the wait failed.
+     */
+    bool wait() {
+        int ret;
+        do {
+            ret = static_cast<int>(syscall(__NR_io_uring_enter, fd_, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0));
+        } while (ret < 0 && errno == EINTR);
+        return ret >= 0;
+    }
+
+    /// Number of queued operations the kernel has not accepted yet.
+    unsigned pending() const { return pending_; }
+
+    /**
+     * @brief Takes the next completion, if any.
+     * @param tag Receives the user tag of the finished operation.
+     * @param result Receives the byte count or negated errno.
+     */
+    bool reap(uint64_t& tag, int& result) {
+        unsigned head = *cq_head_;
+        if (head == __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE)) return false;
+        const io_uring_cqe& cqe = cqes_[head & cq_mask_];
+        tag = cqe.user_data;
+        result = cqe.res;
+        __atomic_store_n(cq_head_, head + 1, __ATOMIC_RELEASE);
+        return true;
+    }
+#endif
+
+private:
+    void release() {
+#if EO_HAVE_IO_URING
+        if (sqes_ && sqes_ != MAP_FAILED) munmap(sqes_, sqes_size_);
+        if (cq_ring_ && cq_ring_ != MAP_FAILED && !single_mmap_) munmap(cq_ring_, cq_size_);
+        if (sq_ring_ && sq_ring_ != MAP_FAILED) munmap(sq_ring_, sq_size_);
+        if (fd_ >= 0) close(fd_);
+        sqes_ = nullptr;
+        sq_ring_ = cq_ring_ = nullptr;
+        fd_ = -1;
+        valid_ = false;
+#endif
+    }
+
+    bool valid_ = false;
+#if EO_HAVE_IO_URING
+    int fd_ = -1;
+    bool single_mmap_ = false;
+    size_t sq_size_ = 0, cq_size_ = 0, sqes_size_ = 0;
+    void* sq_ring_ = nullptr;
+    void* cq_ring_ = nullptr;
+    io_uring_sqe* sqes_ = nullptr;
+    io_uring_cqe* cqes_ = nullptr;
+    unsigned* sq_tail_ = nullptr;
+    unsigned* sq_array_ = nullptr;
+    unsigned* cq_head_ = nullptr;
+    unsigned* cq_tail_ = nullptr;
+    unsigned sq_mask_ = 0, cq_mask_ = 0, pending_ = 0;
+#endif
+};
+
+/**
+ * @brief Reads a descriptor on a background thread into a bounded queue of chunks.
+ *
+ * Reading overlaps with whatever consumes the chunks (decompression,
+ * buffering), so a pipeline over a large pipe is bounded by its slowest stage.
+ * Regular files keep several io_uring reads in flight at increasing offsets;
+ * pipes keep one read pending while the previous chunk is processed. Without
+ * io_uring the thread uses blocking read().
+ */
+class ChunkReader {
+public:
+    /**
+     * @param fd The descriptor to read from.
+     * @param chunk Size of each read.
+     * @param depth Number of reads kept in flight on regular files; also bounds the queue.
+     */
+    explicit ChunkReader(int fd, size_t chunk = 1 << 20, size_t depth = 4)
+        : state_(std::make_shared<State>()) {
+        state_->capacity = depth + 2;
+        auto state = state_;
+        thread_ = std::thread([state, fd, chunk, depth]() {
+            try {
+                struct stat st;
+                bool seekable = fstat(fd, &st) == 0 && S_ISREG(st.st_mode);
+                if (!read_uring(*state, fd, chunk, seekable ? depth : 1, seekable)) {
+                    std::string buffer;
+                    while (read_chunk(fd, buffer, chunk)) {
+                        if (!state->push(std::move(buffer))) break;
+                        buffer = std::string();
+                    }
+                }
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(state->mutex);
+                state->error = std::current_exception();
+            }
+            std::lock_guard<std::mutex> lock(state->mutex);
+            state->done = true;
+            state->cv.notify_all();
+        });
+    }
+
+    ~ChunkReader() {
+        {
+            std::lock_guard<std::mutex> lock(state_->mutex);
+            state_->stopped = true;
+            state_->cv.notify_all();
+        }
+        // A reader blocked on a pipe whose producer keeps running cannot be interrupted; let it go
+        std::lock_guard<std::mutex> lock(state_->mutex);
+        if (state_->done) thread_.join();
+        else thread_.detach();
+    }
+
+    ChunkReader(const ChunkReader&) = delete;
+    ChunkReader& operator=(const ChunkReader&) = delete;
+
+    /**
+     * @brief Appends the next chunk to a buffer, waiting for it if necessary.
+     * @return False at end of input; read errors are rethrown here.
+     */
+    bool next(std::string& buffer) {
+        std::unique_lock<std::mutex> lock(state_->mutex);
+        state_->cv.wait(lock, [&] { return !state_->ready.empty() || state_->done; });
+        if (state_->ready.empty()) {
+            if (state_->error) std::rethrow_exception(state_->error);
+            return false;
+        }
+        std::string chunk = std::move(state_->ready.front());
+        state_->ready.pop_front();
+        state_->cv.notify_all();
+        lock.unlock();
+        if (buffer.empty()) buffer = std::move(chunk);
+        else buffer += chunk;
+        return true;
+    }
+
+private:
+    struct State {
+        std::mutex mutex;
+        std::condition_variable cv;
+        std::deque<std::string> ready;
+        size_t capacity = 0;
+        bool done = false;
+        bool stopped = false;
+        std::exception_ptr error;
+
+        /// Queues a chunk, blocking while the consumer is behind; false once the consumer is gone.
+        bool push(std::string chunk) {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, [&] { return ready.size() < capacity || stopped; });
+            if (stopped) return false;
+            ready.push_back(std::move(chunk));
+            cv.notify_all();
+            return true;
+        }
+    };
+
+    /**
+     * @brief Reads fd to the end through io_uring, delivering chunks in file order.
+     * @return False if io_uring is unavailable and nothing was read.
+     */
+    static bool read_uring(State& state, int fd, size_t chunk, size_t depth, bool seekable) {
+#if EO_HAVE_IO_URING
+        struct Slot {
+            std::string buffer;
+            uint64_t offset = 0;
+            size_t filled = 0;
+            bool in_flight = false;
+            bool eof = false;
+        };
+        // Declared before the ring so the buffers outlive it on every exit path
+        std::vector<Slot> slots(depth);
+        IoUring ring(static_cast<unsigned>(depth));
+        if (!ring.valid()) return false;
+        uint64_t offset = seekable ? static_cast<uint64_t>(std::max<off_t>(lseek(fd, 0, SEEK_CUR), 0)) : 0;
+        auto start = [&](size_t s) {
+            Slot& slot = slots[s];
+            if (slot.buffer.size() != chunk) slot.buffer.resize(chunk);
+            ring.queue(IORING_OP_READ, fd, &slot.buffer[slot.filled], chunk - slot.filled,
+                       seekable ? slot.offset + slot.filled : static_cast<uint64_t>(-1), s);
+            slot.in_flight = true;
+        };
+        for (size_t s = 0; s < depth; ++s) {
+            slots[s].offset = offset;
+            offset += chunk;
+            start(s);
+        }
+        size_t in_flight = depth, next = 0;
+        bool finished = false, failed = false;
+        int error = 0;
+        while (in_flight > 0) {
+            if (!ring.submit_and_wait()) {
+                // Nothing was submitted; no completions will arrive for the queued reads
+                error = errno;
+                break;
+            }
+            uint64_t tag;
+            int res;
+            while (ring.reap(tag, res)) {
+                Slot& slot = slots[tag];
+                slot.in_flight = false;
+                --in_flight;
+                if (res < 0 && res != -EINTR && res != -EAGAIN) {
+                    failed = true;
+                    error = -res;
+                } else if (res == 0) {
+                    slot.eof = true;
+                } else if (res > 0) {
+                    slot.filled += res;
+                }
+                // Short reads on regular files are continued in place so chunks stay contiguous
+                if (!finished && !failed && !slot.eof && (res < 0 || (seekable && slot.filled < chunk))) {
+                    start(tag);
+                    ++in_flight;
+                }
+            }
+            // Deliver completed slots in order and reuse them for the next offsets
+            while (!finished && !failed && !slots[next].in_flight) {
+                Slot& slot = slots[next];
+                if (slot.filled > 0) {
+                    std::string data = std::move(slot.buffer);
+                    data.resize(slot.filled);
+                    if (!state.push(std::move(data))) finished = true;
+                }
+                if (slot.eof) finished = true;
+                if (finished) break;
+                slot.filled = 0;
+                slot.offset = offset;
+                offset += chunk;
+                start(next);
+                ++in_flight;
+                next = (next + 1) % depth;
+            }
+        }
+        if (failed || error) {
+            // Reads the kernel accepted may still write into slot buffers; wait for them before unwinding
+            uint64_t tag;
+            int res;
+            while (in_flight > ring.pending()) {
+                while (in_flight > ring.pending() && ring.reap(tag, res)) --in_flight;
+                if (in_flight > ring.pending() && !ring.wait()) break;
+            }
+            throw std::runtime_error(std::string("Failed to read input: ") + std::strerror(error));
+        }
+        return true;
+#else
+        (void)state; (void)fd; (void)chunk; (void)depth; (void)seekable;
+        return false;
+#endif
+    }
+
+    std::shared_ptr<State> state_;
+    std::thread thread_;
+};
+
+/**
+ * @brief Writes output to a descriptor in full, batched through io_uring when available.
+ *
+ * Large outputs (formatted multi-GB JSON) are split into linked 1 MiB writes
+ * submitted together, so the kernel drains them back to back with a single
+ * system call per batch; a short write breaks the chain and the remainder is
+ * resubmitted. Falls back to a write() loop.
+ * @param fd The descriptor to write to.
+ * @param data The bytes to write.
+ * @return False if writing failed (e.g. a closed pipe).
+ */
+bool write_output(int fd, std::string_view data) {
+#if EO_HAVE_IO_URING
+    const size_t chunk = 1 << 20, depth = 8;
+    if (data.size() > chunk) {
+        IoUring ring(depth);
+        if (ring.valid()) {
+            size_t written = 0;
+            while (written < data.size()) {
+                size_t batch = 0;
+                for (size_t pos = written; batch < depth && pos < data.size(); pos += chunk, ++batch) {
+                    size_t len = std::min(chunk, data.size() - pos);
+                    bool link = batch + 1 < depth && pos + len < data.size();
+                    ring.queue(IORING_OP_WRITE, fd, const_cast<char*>(data.data() + pos), len, static_cast<uint64_t>(-1), batch, link);
+                }
+                // Linked writes complete in order; stop counting at the first short or cancelled one
+                size_t completed = 0, progress = 0;
+                bool broken = false;
+                while (completed < batch) {
+                    if (!ring.submit_and_wait()) return false;
+                    uint64_t tag;
+                    int res;
+                    while (ring.reap(tag, res)) {
+                        ++completed;
+                        if (broken) continue;
+                        size_t len = std::min(chunk, data.size() - written - tag * chunk);
+                        if (res < 0 && res != -EINTR && res != -EAGAIN && res != -ECANCELED) return false;
+                        if (res > 0) progress += res;
+                        if (res != static_cast<int>(len)) broken = true;
+                    }
+                }
+                written += progress;
+            }
+            return true;
+        }
+    }
+#endif
+    while (!data.empty()) {
+        ssize_t n = write(fd, data.data(), data.size());
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        data.remove_prefix(n);
+    }
+    return true;
+}
+
+/**
+ * @brief Compression formats recognized on stdin.
+ */
+enum class Compression { NONE, GZIP, ZSTD, XZ };
+
+/**
+ * @brief Identifies a compressed stream from its magic bytes.
+ * @param head The first bytes of the input.
+ * @return The compression format, or NONE.
+ */
+Compression sniff_compression(std::string_view head) {
+    if (head.substr(0, 2) == "\x1F\x8B") return Compression::GZIP;
+    if (head.substr(0, 4) == "\x28\xB5\x2F\xFD") return Compression::ZSTD;
+    if (head.substr(0, 6) == std::string_view("\xFD" "7zXZ\0", 6)) return Compression::XZ;
+    return Compression::NONE;
+}
+
+#if EO_HAVE_ZLIB
+/**
+ * @brief Returns the total size of a BGZF block starting at data, if it is one.
+ *
+ * BGZF (bgzip, htslib) writes independent gzip members whose header carries
+ * the compressed member size in a "BC" extra subfield, so members can be
+ * located without inflating and decompressed in parallel.
+ * @return The block size in bytes, 0 if data is not a BGZF header, or SIZE_MAX if more bytes are needed.
+ */
+size_t bgzf_block_size(std::string_view data) {
+    if (data.size() < 18) return SIZE_MAX;
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(data.data());
+    if (p[0] != 0x1F || p[1] != 0x8B || p[2] != 8 || !(p[3] & 4)) return 0;
+    size_t xlen = p[10] | p[11] << 8;
+    if (data.size() < 12 + xlen) return SIZE_MAX;
+    for (size_t k = 12; k + 4 <= 12 + xlen;) {
+        size_t slen = p[k + 2] | p[k + 3] << 8;
+        if (p[k] == 'B' && p[k + 1] == 'C' && slen == 2 && k + 6 <= 12 + xlen) return (p[k + 4] | p[k + 5] << 8) + 1;
+        k += 4 + slen;
+    }
+    return 0;
+}
+
+/**
+ * @brief Inflates one complete gzip member.
+ * @param member The compressed member, trailer included.
+ * @return The decompressed bytes.
+ */
+std::string inflate_member(std::string_view member) {
+    std::string out;
+    if (member.size() >= 4) {
+        const unsigned char* t = reinterpret_cast<const unsigned char*>(member.data() + member.size() - 4);
+        out.reserve(t[0] | t[1] << 8 | t[2] << 16 | static_cast<size_t>(t[3]) << 24); // ISIZE trailer
+    }
+    z_stream z{};
+    if (inflateInit2(&z, 16 + MAX_WBITS) != Z_OK) throw std::runtime_error("Failed to initialize gzip decoder");
+    z.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(member.data()));
+    z.avail_in = static_cast<uInt>(member.size());
+    char buf[1 << 16];
+    int ret;
+    do {
+        z.next_out = reinterpret_cast<Bytef*>(buf);
+        z.avail_out = sizeof(buf);
+        ret = inflate(&z, Z_NO_FLUSH);
+        out.append(buf, sizeof(buf) - z.avail_out);
+    } while (ret == Z_OK);
+    inflateEnd(&z);
+    if (ret != Z_STREAM_END) throw std::runtime_error("Corrupt gzip block in input");
+    return out;
+}
+
+/**
+ * @brief Decompresses gzip from a descriptor, in parallel when the stream is BGZF.
+ * @param reader The input chunks.
+ * @param window Bytes already taken from reader.
+ * @param workers Number of parallel decoders for BGZF blocks.
+ * @return The decompressed input.
+ */
+std::string decompress_gzip(ChunkReader& reader, std::string window, size_t workers) {
+    std::string out;
+    bool more = true;
+    size_t pos = 0;
+
+    // Independent BGZF blocks: gather a batch, inflate it in parallel, drop the compressed bytes
+    for (size_t block; (block = bgzf_block_size(std::string_view(window).substr(pos))) != 0;) {
+        std::vector<std::string_view> batch;
+        while (batch.size() < workers * 4) {
+            block = bgzf_block_size(std::string_view(window).substr(pos));
+            if (block == 0) break;
+            if (block == SIZE_MAX || pos + block > window.size()) {
+                if (!more) throw std::runtime_error("Truncated gzip input");
+                if (!batch.empty()) break;
+                more = reader.next(window);
+                continue;
+            }
+            batch.emplace_back(window.data() + pos, block);
+            pos += block;
+        }
+        Scheduler::global().ordered(batch.size(), [&](size_t b) { return inflate_member(batch[b]); },
+                                    [&](size_t, std::string part) { out += part; });
+        window.erase(0, pos);
+        pos = 0;
+        if (window.size() < 18 && more) more = reader.next(window);
+        if (window.empty()) return out;
+    }
+
+    // Ordinary (possibly multi-member) gzip: a single streaming decoder
+    z_stream z{};
+    if (inflateInit2(&z, 16 + MAX_WBITS) != Z_OK) throw std::runtime_error("Failed to initialize gzip decoder");
+    char buf[1 << 16];
+    bool ended = false;
+    while (true) {
+        z.next_in = reinterpret_cast<Bytef*>(&window[pos]);
+        z.avail_in = static_cast<uInt>(window.size() - pos);
+        while (z.avail_in > 0) {
+            if (ended) {
+                // Concatenated members (cat a.gz b.gz, pigz) continue with a fresh header; anything else is trailing junk
+                if (z.next_in[0] != 0x1F) { more = false; break; }
+                inflateReset(&z);
+                ended = false;
+            }
+            z.next_out = reinterpret_cast<Bytef*>(buf);
+            z.avail_out = sizeof(buf);
+            int ret = inflate(&z, Z_NO_FLUSH);
+            out.append(buf, sizeof(buf) - z.avail_out);
+            if (ret == Z_STREAM_END) {
+                ended = true;
+            } else if (ret != Z_OK) {
+                inflateEnd(&z);
+                throw std::runtime_error("Corrupt gzip input");
+            }
+        }
+        window.clear();
+        pos = 0;
+        if (!more || !(more = reader.next(window))) break;
+    }
+    inflateEnd(&z);
+    if (!ended) throw std::runtime_error("Truncated gzip input");
+    return out;
+}
+#endif
+
+#if EO_HAVE_ZSTD
+/**
+ * @brief Decompresses one or more complete zstd frames with a streaming context.
+ * @param ctx The decompression context, reset before use.
+ * @param frames The compressed frames.
+ * @param out The buffer to append decompressed bytes to.
+ */
+void decompress_zstd_frames(ZSTD_DCtx* ctx, std::string_view frames, std::string& out) {
+    unsigned long long size = ZSTD_getFrameContentSize(frames.data(), frames.size());
+    if (size != ZSTD_CONTENTSIZE_UNKNOWN && size != ZSTD_CONTENTSIZE_ERROR) out.reserve(out.size() + size);
+    ZSTD_DCtx_reset(ctx, ZSTD_reset_session_only);
+    ZSTD_inBuffer in{frames.data(), frames.size(), 0};
+    char buf[1 << 17];
+    size_t ret;
+    ZSTD_outBuffer o;
+    do {
+        o = ZSTD_outBuffer{buf, sizeof(buf), 0};
+        ret = ZSTD_decompressStream(ctx, &o, &in);
+        if (ZSTD_isError(ret)) throw std::runtime_error(std::string("Corrupt zstd input: ") + ZSTD_getErrorName(ret));
+        out.append(buf, o.pos);
+    } while (in.pos < in.size || o.pos == o.size);
+    if (ret != 0) throw std::runtime_error("Truncated zstd input");
+}
+
+/**
+ * @brief Decompresses zstd from a descriptor, decoding independent frames in parallel.
+ *
+ * Complete frames (pzstd, `zstd --rsyncable` splits, concatenated files) are
+ * collected in batches and decoded concurrently. A frame too large to buffer
+ * is streamed through a single decoder instead, so the compressed copy is
+ * never held in full.
+ * @param reader The input chunks.
+ * @param window Bytes already taken from reader.
+ * @param workers Number of parallel decoders.
+ * @return The decompressed input.
+ */
+std::string decompress_zstd(ChunkReader& reader, std::string window, size_t workers) {
+    const size_t stream_threshold = 8 << 20;
+    std::string out;
+    bool more = true;
+    std::unique_ptr<ZSTD_DCtx, size_t (*)(ZSTD_DCtx*)> stream(ZSTD_createDCtx(), ZSTD_freeDCtx);
+    while (!window.empty() || more) {
+        // Gather complete frames from the front of the window
+        std::vector<std::string_view> batch;
+        size_t pos = 0;
+        while (batch.size() < workers * 4 && pos < window.size()) {
+            size_t frame = ZSTD_findFrameCompressedSize(window.data() + pos, window.size() - pos);
+            if (ZSTD_isError(frame)) break;
+            batch.emplace_back(window.data() + pos, frame);
+            pos += frame;
+        }
+        if (!batch.empty() && (batch.size() >= workers * 4 || !more || window.size() >= stream_threshold)) {
+            Scheduler::global().ordered(batch.size(), [&](size_t b) {
+                // One context per worker thread, reused across frames and batches
+                thread_local std::unique_ptr<ZSTD_DCtx, size_t (*)(ZSTD_DCtx*)> ctx(ZSTD_createDCtx(), ZSTD_freeDCtx);
+                std::string part;
+                decompress_zstd_frames(ctx.get(), batch[b], part);
+                return part;
+            }, [&](size_t, std::string part) { out += part; });
+            window.erase(0, pos);
+            if (window.empty() && more) more = reader.next(window);
+            continue;
+        }
+        if (window.size() < stream_threshold && more) {
+            more = reader.next(window);
+            continue;
+        }
+        if (!more) throw std::runtime_error("Truncated zstd input");
+
+        // One large frame: stream it chunk by chunk until the frame ends
+        ZSTD_DCtx_reset(stream.get(), ZSTD_reset_session_only);
+        char buf[1 << 17];
+        size_t ret = 1;
+        while (ret != 0) {
+            ZSTD_inBuffer in{window.data(), window.size(), 0};
+            while (in.pos < in.size && ret != 0) {
+                ZSTD_outBuffer o{buf, sizeof(buf), 0};
+                ret = ZSTD_decompressStream(stream.get(), &o, &in);
+                if (ZSTD_isError(ret)) throw std::runtime_error(std::string("Corrupt zstd input: ") + ZSTD_getErrorName(ret));
+                out.append(buf, o.pos);
+            }
+            // Flush output still buffered in the decoder
+            while (ret != 0 && in.pos == in.size) {
+                ZSTD_outBuffer o{buf, sizeof(buf), 0};
+                ret = ZSTD_decompressStream(stream.get(), &o, &in);
+                if (ZSTD_isError(ret)) throw std::runtime_error(std::string("Corrupt zstd input: ") + ZSTD_getErrorName(ret));
+                out.append(buf, o.pos);
+                if (o.pos < o.size) break;
+            }
+            window.erase(0, in.pos);
+            if (ret != 0) {
+                if (!more) throw std::runtime_error("Truncated zstd input");
+                more = reader.next(window);
+            }
+        }
+        if (window.empty() && more) more = reader.next(window);
+    }
+    return out;
+}
+#endif
+
+#if EO_HAVE_LZMA
+/**
+ * @brief Decompresses xz from a descriptor, using liblzma's threaded decoder where available.
+ * @param reader The input chunks.
+ * @param window Bytes already taken from reader.
+ * @param workers Number of decoder threads for multi-block streams (xz -T).
+ * @return The decompressed input.
+ */
+std::string decompress_xz(ChunkReader& reader, std::string window, size_t workers) {
+    lzma_stream z = LZMA_STREAM_INIT;
+#if LZMA_VERSION >= 50040002
+    lzma_mt mt{};
+    mt.flags = LZMA_CONCATENATED;
+    mt.threads = static_cast<uint32_t>(workers);
+    mt.memlimit_threading = std::max<uint64_t>(lzma_physmem() / 4, 64 << 20);
+    mt.memlimit_stop = UINT64_MAX;
+    lzma_ret init = lzma_stream_decoder_mt(&z, &mt);
+#else
+    (void)workers;
+    lzma_ret init = lzma_stream_decoder(&z, UINT64_MAX, LZMA_CONCATENATED);
+#endif
+    if (init != LZMA_OK) throw std::runtime_error("Failed to initialize xz decoder");
+    std::string out;
+    char buf[1 << 17];
+    bool more = true;
+    lzma_ret ret = LZMA_OK;
+    while (ret == LZMA_OK) {
+        z.next_in = reinterpret_cast<const uint8_t*>(window.data());
+        z.avail_in = window.size();
+        lzma_action action = more ? LZMA_RUN : LZMA_FINISH;
+        do {
+            z.next_out = reinterpret_cast<uint8_t*>(buf);
+            z.avail_out = sizeof(buf);
+            ret = lzma_code(&z, action);
+            out.append(buf, sizeof(buf) - z.avail_out);
+        } while (ret == LZMA_OK && (z.avail_in > 0 || z.avail_out == 0 || action == LZMA_FINISH));
+        window.clear();
+        if (more) more = reader.next(window);
+    }
+    lzma_end(&z);
+    if (ret != LZMA_STREAM_END) throw std::runtime_error("Corrupt or truncated xz input");
+    return out;
+}
+#endif
+
 /**
  * @brief Reads input from standard input (stdin) into a string.
- * @return The complete input as a string.
+ *
+ * gzip, zstd and xz streams are recognized by their magic bytes and
+ * decompressed on the fly, so `cat app.log.gz | eo` works without a
+ * separate decompressor. Formats built without their library are returned
+ * as-is and shown as binary.
+ * @return The complete (decompressed) input as a string.
  */
 std::string read_input() {
-    std::stringstream buffer;
-    buffer << std::cin.rdbuf();
-    return buffer.str();
+    ChunkReader reader(STDIN_FILENO);
+    std::string input;
+    bool more = true;
+    while (more && input.size() < 6) more = reader.next(input);
+    size_t workers = Scheduler::global().jobs();
+    switch (sniff_compression(input)) {
+#if EO_HAVE_ZLIB
+    case Compression::GZIP: return decompress_gzip(reader, std::move(input), workers);
+#endif
+#if EO_HAVE_ZSTD
+    case Compression::ZSTD: return decompress_zstd(reader, std::move(input), workers);
+#endif
+#if EO_HAVE_LZMA
+    case Compression::XZ: return decompress_xz(reader, std::move(input), workers);
+#endif
+    default: break;
+    }
+    struct stat st;
+    if (fstat(STDIN_FILENO, &st) == 0 && S_ISREG(st.st_mode)) input.reserve(st.st_size + 1);
+    while (more) more = reader.next(input);
+    return input;
 }
 
 /**
- * @brief Detects the format of the input data (JSON, Table, or Plain Text).
- * @param input The input string to analyze.
- * @return The detected Format (JSON, TABLE, or PLAIN_TEXT).
+ * @brief Event sink for the streaming YAML parser.
+ *
+ * Extends the nlohmann SAX interface with document boundaries so that every
+ * document of a multi-document stream (e.g. `kubectl get -o yaml`, Helm
+ * manifests) is delivered as its own sequence of events.
  */
-Format detect_format(const std::string& input) {
-    if (input.empty()) return Format::PLAIN_TEXT;
+class YamlEvents : public nlohmann::json_sax<nlohmann::json> {
+public:
+    virtual bool start_document() = 0;
+    virtual bool end_document() = 0;
+};
 
-    // Attempt to parse input as JSON
-    try {
-        auto j = nlohmann::json::parse(input);
-        if (j.is_object() || j.is_array()) {
-            return Format::JSON;
+// YAML documents keep their keys in source order; a formatter must not reorder a manifest
+using YamlDocument = nlohmann::ordered_json;
+
+/**
+ * @brief Builds one DOM per YAML document from parser events, keys in source order.
+ */
+class YamlDomBuilder : public YamlEvents {
+public:
+    std::vector<YamlDocument> documents;
+
+    bool start_document() override { documents.emplace_back(); stack_.clear(); return true; }
+    bool end_document() override { return true; }
+    bool null() override { return add(nullptr); }
+    bool boolean(bool val) override { return add(val); }
+    bool number_integer(number_integer_t val) override { return add(val); }
+    bool number_unsigned(number_unsigned_t val) override { return add(val); }
+    bool number_float(number_float_t val, const string_t&) override { return add(val); }
+    bool string(string_t& val) override { return add(std::move(val)); }
+    bool binary(binary_t& val) override { return add(YamlDocument::binary(val)); }
+    bool start_object(std::size_t) override { stack_.push_back(add_node(YamlDocument::object())); return true; }
+    bool key(string_t& val) override { key_ = std::move(val); return true; }
+    bool end_object() override { stack_.pop_back(); return true; }
+    bool start_array(std::size_t) override { stack_.push_back(add_node(YamlDocument::array())); return true; }
+    bool end_array() override { stack_.pop_back(); return true; }
+    bool parse_error(std::size_t, const std::string&, const nlohmann::detail::exception&) override { return false; }
+
+private:
+    std::vector<YamlDocument*> stack_;
+    std::string key_;
+
+    // Inserts a value at the current position and returns a pointer to it
+    YamlDocument* add_node(YamlDocument value) {
+        if (stack_.empty()) {
+            documents.back() = std::move(value);
+            return &documents.back();
+        }
+        YamlDocument& parent = *stack_.back();
+        if (parent.is_array()) {
+            parent.push_back(std::move(value));
+            return &parent.back();
         }
-    } catch (...) {}
+        YamlDocument& slot = parent[key_];
+        slot = std::move(value);
+        return &slot;
+    }
+    bool add(YamlDocument value) { add_node(std::move(value)); return true; }
+};
 
-    // Check for table structure by verifying consistent column counts
-    std::istringstream iss(input);
-    std::string line;
-    std::vector<std::vector<std::string>> rows;
-    bool is_table = true;
-    while (std::getline(iss, line)) {
-        std::istringstream line_stream(line);
-        std::vector<std::string> fields;
-        std::string field;
-        while (line_stream >> field) fields.push_back(field);
-        if (rows.empty()) {
-            rows.push_back(fields);
-        } else if (fields.size() != rows[0].size()) {
-            is_table = false;
-            break;
+/**
+ * @brief Streaming, event-based parser for block-style YAML.
+ *
+ * The input is consumed line by line and each document of a multi-document
+ * stream is parsed and emitted as soon as its terminating `---`/`...` marker
+ * (or the end of input) is seen, so only one document's lines are buffered at
+ * a time. Supports block mappings and sequences, plain/quoted scalars, literal
+ * and folded block scalars and flow collections; anchors and tags are dropped
+ * and aliases are kept as plain strings. Throws std::runtime_error on
+ * malformed input.
+ */
+class YamlParser {
+public:
+    YamlParser(const std::string& input, YamlEvents& events, std::pmr::memory_resource* arena = std::pmr::get_default_resource())
+        : input_(input), events_(events), lines_(arena) {}
+
+    /**
+     * @brief Parses the whole stream, emitting events for every non-empty document.
+     */
+    void parse() {
+        size_t start = 0;
+        size_t number = 0;
+        while (start < input_.size()) {
+            size_t end = input_.find('\n', start);
+            if (end == std::string::npos) end = input_.size();
+            std::string_view raw(input_.data() + start, end - start);
+            if (!raw.empty() && raw.back() == '\r') raw.remove_suffix(1);
+            start = end + 1;
+            ++number;
+
+            if (raw == "---" || raw.rfind("--- ", 0) == 0 || raw == "...") {
+                flush_document();
+                continue;
+            }
+            if (raw.rfind("%", 0) == 0 && lines_.empty()) continue; // %YAML / %TAG directives
+
+            Line line;
+            line.number = number;
+            line.indent = raw.find_first_not_of(' ');
+            if (line.indent == std::string_view::npos) line.indent = raw.size();
+            line.raw = raw.substr(line.indent);
+            line.text = strip_comment(line.raw);
+            lines_.push_back(line);
+        }
+        flush_document();
+    }
+
+private:
+    struct Line {
+        size_t indent = 0;
+        std::string_view raw;  // Content after indentation, comments included
+        std::string_view text; // Content with comments and trailing spaces removed
+        size_t number = 0;
+    };
+    struct Stop {}; // Thrown when an event handler asks to stop
+
+    const std::string& input_;
+    YamlEvents& events_;
+    std::pmr::vector<Line> lines_;
+    size_t pos_ = 0;
+
+    static std::string_view trim(std::string_view s) {
+        size_t b = s.find_first_not_of(" \t");
+        if (b == std::string_view::npos) return {};
+        size_t e = s.find_last_not_of(" \t");
+        return s.substr(b, e - b + 1);
+    }
+
+    // Removes a trailing `# comment` that is not inside a quoted scalar
+    static std::string_view strip_comment(std::string_view s) {
+        char quote = 0;
+        for (size_t i = 0; i < s.size(); ++i) {
+            char c = s[i];
+            if (quote) {
+                if (c == '\\' && quote == '"') ++i;
+                else if (c == quote) quote = 0;
+            } else if (c == '"' || c == '\'') {
+                if (i == 0 || s[i - 1] == ' ' || s[i - 1] == '[' || s[i - 1] == '{' || s[i - 1] == ',' || s[i - 1] == ':') quote = c;
+            } else if (c == '#' && (i == 0 || s[i - 1] == ' ' || s[i - 1] == '\t')) {
+                return trim(s.substr(0, i));
+            }
+        }
+        return trim(s);
+    }
+
+    [[noreturn]] void fail(const std::string& what, size_t number) const {
+        throw std::runtime_error("YAML line " + std::to_string(number) + ": " + what);
+    }
+
+    void check(bool ok) { if (!ok) throw Stop{}; }
+
+    void flush_document() {
+        bool has_content = std::any_of(lines_.begin(), lines_.end(), [](const Line& l) { return !l.text.empty(); });
+        if (has_content) {
+            pos_ = 0;
+            try {
+                check(events_.start_document());
+                skip_blank();
+                parse_node(lines_[pos_].indent);
+                skip_blank();
+                if (pos_ < lines_.size()) fail("unexpected content", lines_[pos_].number);
+                check(events_.end_document());
+            } catch (const Stop&) {}
+        }
+        lines_.clear();
+    }
+
+    void skip_blank() {
+        while (pos_ < lines_.size() && lines_[pos_].text.empty()) ++pos_;
+    }
+
+    static bool is_sequence_item(std::string_view text) {
+        return !text.empty() && text[0] == '-' && (text.size() == 1 || text[1] == ' ');
+    }
+
+    // Drops leading `&anchor` and `!tag` properties from a value
+    static std::string_view strip_properties(std::string_view v) {
+        while (!v.empty() && (v[0] == '&' || v[0] == '!')) {
+            size_t sp = v.find(' ');
+            v = sp == std::string_view::npos ? std::string_view() : trim(v.substr(sp));
+        }
+        return v;
+    }
+
+    /**
+     * @brief Splits `key: value` into its parts.
+     * @return True if the text is a mapping entry.
+     */
+    bool split_key(std::string_view text, std::string& key, std::string_view& rest) const {
+        if (text.empty() || is_sequence_item(text) || text[0] == '[' || text[0] == '{' || text[0] == '#') return false;
+        size_t colon;
+        if (text[0] == '"' || text[0] == '\'') {
+            size_t i = 0;
+            std::string unquoted;
+            if (!parse_quoted(text, i, unquoted)) return false;
+            while (i < text.size() && text[i] == ' ') ++i;
+            if (i >= text.size() || text[i] != ':' || (i + 1 < text.size() && text[i + 1] != ' ')) return false;
+            key = std::move(unquoted);
+            colon = i;
         } else {
-            rows.push_back(fields);
+            colon = std::string_view::npos;
+            for (size_t i = 0; i < text.size(); ++i) {
+                if (text[i] == ':' && (i + 1 == text.size() || text[i + 1] == ' ')) { colon = i; break; }
+            }
+            if (colon == std::string_view::npos || colon == 0) return false;
+            key = std::string(trim(text.substr(0, colon)));
         }
+        rest = trim(text.substr(colon + 1));
+        return true;
     }
-    if (is_table && rows.size() > 1 && rows[0].size() > 1) {
-        return Format::TABLE;
+
+    /**
+     * @brief Reads `count` hex digits at text[i], advancing i past them.
+     * @return False if fewer digits remain or one of them is not hex.
+     */
+    static bool read_hex(std::string_view text, size_t& i, size_t count, uint32_t& value) {
+        if (i + count > text.size()) return false;
+        auto [ptr, ec] = std::from_chars(text.data() + i, text.data() + i + count, value, 16);
+        if (ec != std::errc() || ptr != text.data() + i + count) return false;
+        i += count;
+        return true;
+    }
+
+    // Appends a code point as UTF-8
+    static void append_utf8(uint32_t cp, std::string& out) {
+        if (cp < 0x80) {
+            out += static_cast<char>(cp);
+        } else if (cp < 0x800) {
+            out += static_cast<char>(0xC0 | (cp >> 6));
+            out += static_cast<char>(0x80 | (cp & 0x3F));
+        } else if (cp < 0x10000) {
+            out += static_cast<char>(0xE0 | (cp >> 12));
+            out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (cp & 0x3F));
+        } else {
+            out += static_cast<char>(0xF0 | (cp >> 18));
+            out += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+            out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (cp & 0x3F));
+        }
+    }
+
+    /**
+     * @brief Parses a single- or double-quoted scalar starting at text[i].
+     *
+     * Double-quoted escapes include `\xXX`, `\uXXXX` (UTF-16 surrogate pairs
+     * are combined; a lone surrogate becomes U+FFFD) and `\UXXXXXXXX`.
+     * @return False if the closing quote is missing or an escape has bad hex digits.
+     */
+    static bool parse_quoted(std::string_view text, size_t& i, std::string& out) {
+        char quote = text[i++];
+        while (i < text.size()) {
+            char c = text[i++];
+            if (c == quote) {
+                if (quote == '\'' && i < text.size() && text[i] == '\'') { out += '\''; ++i; continue; }
+                return true;
+            }
+            if (c == '\\' && quote == '"' && i < text.size()) {
+                char e = text[i++];
+                uint32_t cp = 0;
+                switch (e) {
+                    case 'n': out += '\n'; break;
+                    case 't': out += '\t'; break;
+                    case 'r': out += '\r'; break;
+                    case '0': out += '\0'; break;
+                    case 'e': out += '\033'; break;
+                    case 'x':
+                        if (!read_hex(text, i, 2, cp)) return false;
+                        append_utf8(cp, out);
+                        break;
+                    case 'U':
+                        if (!read_hex(text, i, 8, cp) || cp > 0x10FFFF) return false;
+                        append_utf8(cp >= 0xD800 && cp < 0xE000 ? 0xFFFD : cp, out);
+                        break;
+                    case 'u': {
+                        if (!read_hex(text, i, 4, cp)) return false;
+                        if (cp >= 0xD800 && cp < 0xDC00) {
+                            // High surrogate: combine with a following \uDC00-\uDFFF
+                            size_t j = i + 2;
+                            uint32_t low = 0;
+                            if (i + 1 < text.size() && text[i] == '\\' && text[i + 1] == 'u' && read_hex(text, j, 4, low) &&
+                                low >= 0xDC00 && low < 0xE000) {
+                                cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                                i = j;
+                            } else {
+                                cp = 0xFFFD;
+                            }
+                        } else if (cp >= 0xDC00 && cp < 0xE000) {
+                            cp = 0xFFFD;
+                        }
+                        append_utf8(cp, out);
+                        break;
+                    }
+                    default: out += e; break;
+                }
+                continue;
+            }
+            out += c;
+        }
+        return false;
+    }
+
+    // Emits a plain scalar with YAML core-schema typing
+    void emit_plain(std::string_view v) {
+        if (v.empty() || v == "~" || v == "null" || v == "Null" || v == "NULL") { check(events_.null()); return; }
+        if (v == "true" || v == "True" || v == "TRUE") { check(events_.boolean(true)); return; }
+        if (v == "false" || v == "False" || v == "FALSE") { check(events_.boolean(false)); return; }
+        size_t digits = (v[0] == '-' || v[0] == '+') ? 1 : 0;
+        bool is_int = digits < v.size() && std::all_of(v.begin() + digits, v.end(), [](char c) { return c >= '0' && c <= '9'; });
+        if (is_int && !(v.size() - digits > 1 && v[digits] == '0')) {
+            std::string s(v);
+            errno = 0;
+            if (v[0] == '-') {
+                long long n = std::strtoll(s.c_str(), nullptr, 10);
+                if (errno == 0) { check(events_.number_integer(n)); return; }
+            } else {
+                unsigned long long n = std::strtoull(s.c_str(), nullptr, 10);
+                if (errno == 0) { check(events_.number_unsigned(n)); return; }
+            }
+        }
+        if (v.find_first_not_of("+-.0123456789eE") == std::string_view::npos &&
+            v.find_first_of("0123456789") != std::string_view::npos && v.find('.') != std::string_view::npos) {
+            std::string s(v);
+            char* end = nullptr;
+            double d = std::strtod(s.c_str(), &end);
+            if (end && *end == '\0') { check(events_.number_float(d, s)); return; }
+        }
+        std::string s(v);
+        check(events_.string(s));
+    }
+
+    /**
+     * @brief Parses a flow collection or scalar inside `[...]` / `{...}` starting at text[i].
+     */
+    void parse_flow(std::string_view text, size_t& i, size_t number) {
+        auto skip_ws = [&]() { while (i < text.size() && text[i] == ' ') ++i; };
+        skip_ws();
+        if (i >= text.size()) fail("unterminated flow collection", number);
+        char c = text[i];
+        if (c == '[' || c == '{') {
+            bool is_map = c == '{';
+            char close = is_map ? '}' : ']';
+            ++i;
+            check(is_map ? events_.start_object(static_cast<std::size_t>(-1)) : events_.start_array(static_cast<std::size_t>(-1)));
+            skip_ws();
+            while (i < text.size() && text[i] != close) {
+                if (is_map) {
+                    std::string key;
+                    if (text[i] == '"' || text[i] == '\'') {
+                        if (!parse_quoted(text, i, key)) fail("unterminated quoted key or invalid escape", number);
+                    } else {
+                        size_t end = text.find_first_of(":,}", i);
+                        if (end == std::string_view::npos) fail("unterminated flow mapping", number);
+                        key = std::string(trim(text.substr(i, end - i)));
+                        i = end;
+                    }
+                    skip_ws();
+                    check(events_.key(key));
+                    if (i < text.size() && text[i] == ':') { ++i; parse_flow(text, i, number); }
+                    else check(events_.null());
+                } else {
+                    parse_flow(text, i, number);
+                }
+                skip_ws();
+                if (i < text.size() && text[i] == ',') { ++i; skip_ws(); }
+            }
+            if (i >= text.size()) fail("unterminated flow collection", number);
+            ++i;
+            check(is_map ? events_.end_object() : events_.end_array());
+        } else if (c == '"' || c == '\'') {
+            std::string s;
+            if (!parse_quoted(text, i, s)) fail("unterminated quoted scalar or invalid escape", number);
+            check(events_.string(s));
+        } else {
+            size_t end = text.find_first_of(",]}", i);
+            if (end == std::string_view::npos) end = text.size();
+            emit_plain(strip_properties(trim(text.substr(i, end - i))));
+            i = end;
+        }
+    }
+
+    /**
+     * @brief Emits an inline value, folding continuation lines of plain scalars.
+     * @param parent_indent Indentation of the owning mapping/sequence entry.
+     */
+    void parse_inline_value(std::string_view v, size_t parent_indent, size_t number) {
+        if (v[0] == '[' || v[0] == '{') {
+            size_t i = 0;
+            parse_flow(v, i, number);
+            if (!trim(v.substr(i)).empty()) fail("unexpected text after flow collection", number);
+            return;
+        }
+        if (v[0] == '"' || v[0] == '\'') {
+            size_t i = 0;
+            std::string s;
+            if (!parse_quoted(v, i, s)) fail("unterminated quoted scalar or invalid escape", number);
+            check(events_.string(s));
+            return;
+        }
+        if (v[0] == '*') { std::string alias(v); check(events_.string(alias)); return; }
+
+        // Plain scalars may continue on more-indented lines
+        std::string folded;
+        while (pos_ < lines_.size() && (lines_[pos_].text.empty() || lines_[pos_].indent > parent_indent)) {
+            if (lines_[pos_].text.empty()) {
+                size_t next = pos_;
+                while (next < lines_.size() && lines_[next].text.empty()) ++next;
+                if (next == lines_.size() || lines_[next].indent <= parent_indent) break;
+            } else {
+                if (folded.empty()) folded = std::string(v);
+                folded += ' ';
+                folded += lines_[pos_].text;
+            }
+            ++pos_;
+        }
+        if (folded.empty()) emit_plain(v);
+        else check(events_.string(folded));
+    }
+
+    /**
+     * @brief Collects a literal (`|`) or folded (`>`) block scalar below parent_indent.
+     */
+    void parse_block_scalar(std::string_view header, size_t parent_indent) {
+        bool folded = header[0] == '>';
+        char chomp = header.find('-') != std::string_view::npos ? '-' : header.find('+') != std::string_view::npos ? '+' : ' ';
+        size_t content_indent = std::string_view::npos;
+        std::string out;
+        bool prev_normal = false; // Previous line was a non-blank line at the content indentation
+        while (pos_ < lines_.size()) {
+            const Line& l = lines_[pos_];
+            if (l.raw.empty()) {
+                // In folded scalars the first blank line only replaces the preceding line break
+                if (!(folded && prev_normal)) out += '\n';
+                prev_normal = false;
+                ++pos_;
+                continue;
+            }
+            if (l.indent <= parent_indent) break;
+            if (content_indent == std::string_view::npos) content_indent = l.indent;
+            if (l.indent < content_indent) break;
+            bool more_indented = l.indent > content_indent;
+            if (folded && prev_normal && !more_indented) out.back() = ' ';
+            out.append(l.indent - content_indent, ' ');
+            out += l.raw;
+            out += '\n';
+            prev_normal = !more_indented;
+            ++pos_;
+        }
+        if (chomp != '+') {
+            size_t last = out.find_last_not_of('\n');
+            out.erase(last == std::string::npos ? 0 : last + 1);
+            if (chomp != '-' && !out.empty()) out += '\n';
+        }
+        check(events_.string(out));
+    }
+
+    // Parses the node whose first line is the current line, located at `indent`
+    void parse_node(size_t indent) {
+        skip_blank();
+        const Line& line = lines_[pos_];
+        std::string key;
+        std::string_view rest;
+        if (is_sequence_item(line.text)) {
+            parse_sequence(indent);
+        } else if (split_key(line.text, key, rest)) {
+            parse_mapping(indent);
+        } else {
+            ++pos_;
+            std::string_view v = strip_properties(line.text);
+            if (v.empty()) check(events_.null());
+            else if (v[0] == '|' || v[0] == '>') parse_block_scalar(v, indent);
+            else parse_inline_value(v, indent, line.number);
+        }
+    }
+
+    void parse_sequence(size_t indent) {
+        check(events_.start_array(static_cast<std::size_t>(-1)));
+        while (true) {
+            skip_blank();
+            if (pos_ >= lines_.size() || lines_[pos_].indent != indent || !is_sequence_item(lines_[pos_].text)) break;
+            Line& line = lines_[pos_];
+            size_t offset = line.text.find_first_not_of(' ', 1);
+            if (offset == std::string_view::npos) {
+                ++pos_;
+                skip_blank();
+                if (pos_ < lines_.size() && lines_[pos_].indent > indent) parse_node(lines_[pos_].indent);
+                else check(events_.null());
+                continue;
+            }
+            // Re-read the item content as a node indented at its own column
+            line.indent += offset;
+            line.text.remove_prefix(offset);
+            line.raw.remove_prefix(offset);
+            parse_node(line.indent);
+        }
+        check(events_.end_array());
+    }
+
+    void parse_mapping(size_t indent) {
+        check(events_.start_object(static_cast<std::size_t>(-1)));
+        while (true) {
+            skip_blank();
+            if (pos_ >= lines_.size() || lines_[pos_].indent != indent) break;
+            const Line& line = lines_[pos_];
+            std::string key;
+            std::string_view rest;
+            if (!split_key(line.text, key, rest)) {
+                if (is_sequence_item(line.text)) break; // Sequence belonging to an outer mapping
+                fail("expected a mapping key", line.number);
+            }
+            check(events_.key(key));
+            ++pos_;
+            std::string_view v = strip_properties(rest);
+            if (v.empty()) {
+                skip_blank();
+                if (pos_ < lines_.size() && lines_[pos_].indent > indent) parse_node(lines_[pos_].indent);
+                else if (pos_ < lines_.size() && lines_[pos_].indent == indent && is_sequence_item(lines_[pos_].text)) parse_sequence(indent);
+                else check(events_.null());
+            } else if (v[0] == '|' || v[0] == '>') {
+                parse_block_scalar(v, indent);
+            } else {
+                parse_inline_value(v, indent, line.number);
+            }
+        }
+        check(events_.end_object());
+    }
+};
+
+/**
+ * @brief Parses a (possibly multi-document) YAML stream into DOM documents.
+ * @param input The raw YAML text.
+ * @param arena Memory resource for the parser's line buffers.
+ * @return One JSON value per non-empty document; throws std::runtime_error if malformed.
+ */
+std::vector<YamlDocument> parse_yaml(const std::string& input, std::pmr::memory_resource* arena = std::pmr::get_default_resource()) {
+    YamlDomBuilder builder;
+    YamlParser(input, builder, arena).parse();
+    return std::move(builder.documents);
+}
+
+/**
+ * @brief Cheap structural check for block YAML, run before attempting a full parse.
+ * @param input The input string to analyze.
+ * @return True if the leading lines look like YAML mappings/sequences.
+ */
+bool looks_like_yaml(std::string_view input) {
+    size_t start = 0;
+    size_t significant = 0, structural = 0;
+    bool nested = false, marker = false;
+    size_t prev_indent = 0;
+    bool prev_opens_block = false;
+    size_t scalar_indent = std::string::npos; // Indentation of an open `|`/`>` block scalar's key
+    while (significant < 64 && start < input.size()) {
+        size_t end = input.find('\n', start);
+        if (end == std::string_view::npos) end = input.size();
+        std::string_view line = input.substr(start, end - start);
+        start = end + 1;
+        if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+        size_t indent = line.find_first_not_of(' ');
+        if (indent == std::string_view::npos || line[indent] == '#') continue;
+        if (scalar_indent != std::string_view::npos && indent > scalar_indent) continue; // Block scalar content
+        scalar_indent = std::string::npos;
+        if (line == "---" || line.rfind("--- ", 0) == 0) { marker = true; continue; }
+        ++significant;
+        std::string_view text = line.substr(indent);
+        bool item = text[0] == '-' && (text.size() == 1 || text[1] == ' ');
+        if (item) text.remove_prefix(std::min<size_t>(2, text.size()));
+        size_t colon = text.find(':');
+        bool keyed = colon != std::string_view::npos && colon > 0 && (colon + 1 == text.size() || text[colon + 1] == ' ') &&
+                     text.substr(0, colon).find(' ') == std::string_view::npos;
+        if (item || keyed) ++structural;
+        if (keyed && colon + 2 < text.size() && (text[colon + 2] == '|' || text[colon + 2] == '>')) scalar_indent = indent;
+        if (prev_opens_block && indent > prev_indent) nested = true;
+        prev_opens_block = keyed && colon + 1 == text.size();
+        prev_indent = indent;
+    }
+    return significant >= 2 && structural * 10 >= significant * 9 && (nested || marker);
+}
+
+// Prompt summaries of JSON/YAML documents: both the DOM path (YAML, prune_json) and the
+// tape path (JSON, JsonTape::write_compact) follow these rules, so the two cannot drift apart.
+constexpr size_t SUMMARY_BUDGET = 48 * 1024; // Target size of a summary in bytes
+constexpr size_t SUMMARY_MAX_STRING = 256;   // String length kept once pruning starts
+
+/**
+ * @brief Whether an object key is dropped from summaries.
+ *
+ * Server-side bookkeeping added by kubectl/Helm carries no information for the reader.
+ */
+bool is_pruned_key(std::string_view key) {
+    return key == "managedFields" || key == "kubectl.kubernetes.io/last-applied-configuration";
+}
+
+/**
+ * @brief The marker that replaces elided array items: "… N more items".
+ */
+std::string elided_items(size_t count) {
+    return "… " + std::to_string(count) + " more items";
+}
+
+/**
+ * @brief Finds where to cut a string to at most `max_bytes` without splitting a UTF-8 sequence.
+ * @param text The string contents (without quotes).
+ * @param max_bytes The length limit.
+ * @param escaped The text is JSON-escaped; escape sequences are not split either.
+ * @return The length of the prefix to keep.
+ */
+size_t summary_cut(std::string_view text, size_t max_bytes, bool escaped) {
+    size_t cut = 0;
+    while (cut < text.size()) {
+        unsigned char c = static_cast<unsigned char>(text[cut]);
+        size_t len = escaped && c == '\\' ? (cut + 1 < text.size() && text[cut + 1] == 'u' ? 6 : 2)
+                                          : c >= 0xF0 ? 4 : c >= 0xE0 ? 3 : c >= 0xC0 ? 2 : 1;
+        if (cut + len > max_bytes) break;
+        cut += len;
+    }
+    return cut;
+}
+
+/**
+ * @brief Runs a summary writer with progressively tighter limits until its output fits SUMMARY_BUDGET.
+ *
+ * The first attempt only drops pruned keys; later ones keep 64, 32, ... 1
+ * items per array and SUMMARY_MAX_STRING bytes per string.
+ * @param write Callable (max_items, max_string, std::string& out) returning true if out fits the budget.
+ * @return The first output that fits, or the most pruned one.
+ */
+template <typename Write>
+std::string summarize_within_budget(Write&& write) {
+    std::string text;
+    for (size_t max_items = SIZE_MAX; max_items > 0; max_items = max_items == SIZE_MAX ? 64 : max_items / 2) {
+        text.clear();
+        if (write(max_items, max_items == SIZE_MAX ? SIZE_MAX : SUMMARY_MAX_STRING, text)) break;
+    }
+    return text;
+}
+
+/**
+ * @brief Drops noise and truncates large arrays/strings so a document fits a prompt.
+ * @param j The document to prune.
+ * @param max_items Maximum number of elements kept per array.
+ * @param max_string Maximum length of string values.
+ * @return The pruned copy; elided array items are replaced by an elided_items() marker.
+ */
+YamlDocument prune_json(const YamlDocument& j, size_t max_items, size_t max_string) {
+    if (j.is_object()) {
+        YamlDocument out = YamlDocument::object();
+        for (auto it = j.begin(); it != j.end(); ++it) {
+            if (is_pruned_key(it.key())) continue;
+            out[it.key()] = prune_json(it.value(), max_items, max_string);
+        }
+        return out;
+    }
+    if (j.is_array()) {
+        YamlDocument out = YamlDocument::array();
+        size_t kept = std::min(j.size(), max_items);
+        for (size_t i = 0; i < kept; ++i) out.push_back(prune_json(j[i], max_items, max_string));
+        if (j.size() > kept) out.push_back(elided_items(j.size() - kept));
+        return out;
+    }
+    if (j.is_string() && j.get_ref<const std::string&>().size() > max_string) {
+        const std::string& text = j.get_ref<const std::string&>();
+        return text.substr(0, summary_cut(text, max_string, false)) + "…";
+    }
+    return j;
+}
+
+/**
+ * @brief Produces the prompt representation of a YAML document, pruned to a size budget.
+ *
+ * The document is serialized as compact JSON: indentation is whitespace the
+ * model would otherwise have to prefill, while the user-visible rendering
+ * keeps the pretty form.
+ * @param j The parsed document.
+ * @return The minified document, at most roughly SUMMARY_BUDGET bytes for typical inputs.
+ */
+std::string summarize_json(const YamlDocument& j) {
+    return summarize_within_budget([&](size_t max_items, size_t max_string, std::string& out) {
+        out = prune_json(j, max_items, max_string).dump();
+        return out.size() <= SUMMARY_BUDGET;
+    });
+}
+
+// Token kinds produced by JsonTokenizer
+enum class JsonToken { BEGIN_OBJECT, END_OBJECT, BEGIN_ARRAY, END_ARRAY, COLON, COMMA, STRING, NUMBER, LITERAL, END, NEED_MORE, INVALID };
+
+/**
+ * @brief Allocation-free JSON lexer over a byte buffer.
+ *
+ * Tokens are returned as [begin, pos) ranges into the caller's buffer. When a
+ * token may continue past the end of the buffer and `final` is false,
+ * NEED_MORE is returned and `pos` is left at the token start, so callers can
+ * append the next chunk of a stream and resume from there.
+ */
+struct JsonTokenizer {
+    static bool is_space(char c) { return c == ' ' || c == '\n' || c == '\r' || c == '\t'; }
+
+    /**
+     * @brief Checks a NUMBER token against the JSON grammar: -?(0|[1-9][0-9]*)(.[0-9]+)?([eE][+-]?[0-9]+)?
+     *
+     * next() only finds where a number ends; this rejects `01`, `1-2`, `1.` and `1e`.
+     */
+    static bool valid_number(std::string_view t) {
+        size_t i = 0, n = t.size();
+        auto digits = [&]() {
+            size_t b = i;
+            while (i < n && t[i] >= '0' && t[i] <= '9') ++i;
+            return i > b;
+        };
+        if (i < n && t[i] == '-') ++i;
+        if (i < n && t[i] == '0') ++i;
+        else if (!digits()) return false;
+        if (i < n && t[i] == '.' && (++i, !digits())) return false;
+        if (i < n && (t[i] == 'e' || t[i] == 'E')) {
+            ++i;
+            if (i < n && (t[i] == '+' || t[i] == '-')) ++i;
+            if (!digits()) return false;
+        }
+        return i == n;
+    }
+
+    /**
+     * @brief Checks a STRING token (quotes included) for raw control characters and invalid escapes.
+     *
+     * Allowed escapes are \" \\ \/ \b \f \n \r \t and \u followed by four hex digits.
+     */
+    static bool valid_string(std::string_view t) {
+        for (size_t i = 1; i + 1 < t.size(); ++i) {
+            unsigned char c = static_cast<unsigned char>(t[i]);
+            if (c < 0x20) return false;
+            if (c != '\\') continue;
+            char e = t[++i];
+            if (e == 'u') {
+                if (i + 4 >= t.size() || !std::all_of(t.begin() + i + 1, t.begin() + i + 5, [](char h) { return std::isxdigit(static_cast<unsigned char>(h)); })) return false;
+                i += 4;
+            } else if (std::string_view("\"\\/bfnrt").find(e) == std::string_view::npos) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * @brief Scans the next token.
+     * @param buf The buffer being tokenized.
+     * @param pos In: scan position. Out: position just past the token.
+     * @param begin Out: position of the first byte of the token.
+     * @param final True if no more data follows the buffer.
+     * @return The token kind.
+     */
+    static JsonToken next(std::string_view buf, size_t& pos, size_t& begin, bool final) {
+        const size_t n = buf.size();
+        while (pos < n && is_space(buf[pos])) ++pos;
+        begin = pos;
+        if (pos >= n) return final ? JsonToken::END : JsonToken::NEED_MORE;
+        char c = buf[pos];
+        switch (c) {
+            case '{': ++pos; return JsonToken::BEGIN_OBJECT;
+            case '}': ++pos; return JsonToken::END_OBJECT;
+            case '[': ++pos; return JsonToken::BEGIN_ARRAY;
+            case ']': ++pos; return JsonToken::END_ARRAY;
+            case ':': ++pos; return JsonToken::COLON;
+            case ',': ++pos; return JsonToken::COMMA;
+            case '"': {
+                // Jump between quotes with memchr; a quote preceded by an odd run of backslashes is escaped
+                size_t i = pos + 1;
+                while (true) {
+                    const void* q = i < n ? std::memchr(buf.data() + i, '"', n - i) : nullptr;
+                    if (!q) return final ? JsonToken::INVALID : JsonToken::NEED_MORE;
+                    size_t k = static_cast<const char*>(q) - buf.data();
+                    size_t j = k;
+                    while (j > pos + 1 && buf[j - 1] == '\\') --j;
+                    if ((k - j) % 2 == 0) { pos = k + 1; return JsonToken::STRING; }
+                    i = k + 1;
+                }
+            }
+            default:
+                break;
+        }
+        size_t i = pos;
+        if (c == '-' || (c >= '0' && c <= '9')) {
+            while (i < n && ((buf[i] >= '0' && buf[i] <= '9') || buf[i] == '-' || buf[i] == '+' || buf[i] == '.' || buf[i] == 'e' || buf[i] == 'E')) ++i;
+            if (i == n && !final) return JsonToken::NEED_MORE;
+            pos = i;
+            return JsonToken::NUMBER;
+        }
+        if (c >= 'a' && c <= 'z') {
+            while (i < n && buf[i] >= 'a' && buf[i] <= 'z') ++i;
+            if (i == n && !final) return JsonToken::NEED_MORE;
+            std::string_view word = buf.substr(pos, i - pos);
+            if (word != "true" && word != "false" && word != "null") return JsonToken::INVALID;
+            pos = i;
+            return JsonToken::LITERAL;
+        }
+        return JsonToken::INVALID;
+    }
+};
+
+/**
+ * @brief Tracks JSON grammar state (nesting and the expected next token) over a token stream.
+ */
+class JsonStructure {
+public:
+    enum class Expect { VALUE, KEY_OR_END, KEY, COLON, VALUE_OR_END, COMMA_OR_END, DONE };
+
+    // Accept further top-level values after the first one (NDJSON)
+    explicit JsonStructure(bool multiple_values = false) : multiple_(multiple_values) {}
+
+    /**
+     * @brief Advances the state by one token.
+     * @param tok The token kind.
+     * @param first The first byte of the token text.
+     * @return False if the token is not allowed here.
+     */
+    bool accept(JsonToken tok, char first) {
+        switch (tok) {
+            case JsonToken::COMMA:
+                if (expect_ != Expect::COMMA_OR_END) return false;
+                expect_ = in_object() ? Expect::KEY : Expect::VALUE;
+                return true;
+            case JsonToken::COLON:
+                if (expect_ != Expect::COLON) return false;
+                expect_ = Expect::VALUE;
+                return true;
+            case JsonToken::END_OBJECT:
+            case JsonToken::END_ARRAY: {
+                char open = tok == JsonToken::END_OBJECT ? '{' : '[';
+                if (stack_.empty() || stack_.back() != open) return false;
+                if (expect_ != Expect::COMMA_OR_END && expect_ != (open == '{' ? Expect::KEY_OR_END : Expect::VALUE_OR_END)) return false;
+                stack_.pop_back();
+                expect_ = stack_.empty() ? Expect::DONE : Expect::COMMA_OR_END;
+                return true;
+            }
+            case JsonToken::STRING:
+                if (expect_ == Expect::KEY_OR_END || expect_ == Expect::KEY) {
+                    expect_ = Expect::COLON;
+                    return true;
+                }
+                break;
+            case JsonToken::NUMBER:
+            case JsonToken::LITERAL:
+            case JsonToken::BEGIN_OBJECT:
+            case JsonToken::BEGIN_ARRAY:
+                break;
+            default:
+                return false;
+        }
+
+        // Remaining tokens start a value
+        if (expect_ == Expect::DONE ? !multiple_ : expect_ != Expect::VALUE && expect_ != Expect::VALUE_OR_END) return false;
+        if (tok == JsonToken::BEGIN_OBJECT || tok == JsonToken::BEGIN_ARRAY) {
+            stack_.push_back(first);
+            expect_ = first == '{' ? Expect::KEY_OR_END : Expect::VALUE_OR_END;
+        } else {
+            expect_ = stack_.empty() ? Expect::DONE : Expect::COMMA_OR_END;
+        }
+        return true;
+    }
+
+    Expect expect() const { return expect_; }
+    size_t depth() const { return stack_.size(); }
+    bool in_object() const { return !stack_.empty() && stack_.back() == '{'; }
+    bool complete() const { return stack_.empty() && expect_ == Expect::DONE; }
+
+private:
+    bool multiple_;
+    std::vector<char> stack_;
+    Expect expect_ = Expect::VALUE;
+};
+
+/**
+ * @brief Checks that the input is one well-formed JSON object or array, without building a DOM.
+ * @param input The input to check.
+ * @return True if the tokens form exactly one complete object or array, with numbers
+ *         and strings that follow the JSON grammar.
+ */
+bool validate_json(std::string_view input) {
+    JsonStructure structure;
+    size_t pos = 0, begin = 0;
+    JsonToken tok = JsonTokenizer::next(input, pos, begin, true);
+    if (tok != JsonToken::BEGIN_OBJECT && tok != JsonToken::BEGIN_ARRAY) return false;
+    while (tok != JsonToken::END) {
+        if (!structure.accept(tok, input[begin])) return false;
+        if (tok == JsonToken::NUMBER && !JsonTokenizer::valid_number(input.substr(begin, pos - begin))) return false;
+        if (tok == JsonToken::STRING && !JsonTokenizer::valid_string(input.substr(begin, pos - begin))) return false;
+        tok = JsonTokenizer::next(input, pos, begin, true);
+    }
+    return structure.complete();
+}
+
+/**
+ * @brief Incremental JSON pretty-printer and syntax highlighter.
+ *
+ * Works directly on the JsonTokenizer token stream, writing indentation and
+ * ANSI colors in one pass without building a DOM. Input can be supplied in
+ * arbitrary chunks via feed(); a token split across chunks is carried over.
+ * Consecutive top-level values (NDJSON) are printed one after another.
+ */
+class JsonHighlighter {
+public:
+    // Precomputed ANSI sequences per token class
+    static constexpr std::string_view KEY_COLOR = "\033[1;34m";
+    static constexpr std::string_view STRING_COLOR = "\033[32m";
+    static constexpr std::string_view NUMBER_COLOR = "\033[33m";
+    static constexpr std::string_view BOOL_COLOR = "\033[35m";
+    static constexpr std::string_view NULL_COLOR = "\033[2m";
+    static constexpr std::string_view RESET = "\033[0m";
+
+    JsonHighlighter(int indent, std::string& out) : indent_(indent), out_(out), structure_(true) {}
+
+    /**
+     * @brief Highlights the next chunk of input, appending to the output string.
+     * @return False once a syntax error has been found.
+     */
+    bool feed(std::string_view chunk) {
+        if (!error_.empty()) return false;
+        if (carry_.empty()) {
+            size_t used = process(chunk, false);
+            carry_.assign(chunk.substr(used));
+        } else {
+            carry_.append(chunk);
+            size_t used = process(carry_, false);
+            carry_.erase(0, used);
+        }
+        return error_.empty();
+    }
+
+    /**
+     * @brief Flushes any carried-over token and checks that the document is complete.
+     * @return False if the input was malformed or truncated.
+     */
+    bool finish() {
+        if (!error_.empty()) return false;
+        process(carry_, true);
+        carry_.clear();
+        if (error_.empty() && !structure_.complete()) error_ = "unexpected end of input";
+        return error_.empty();
+    }
+
+    const std::string& error() const { return error_; }
+
+private:
+    using Expect = JsonStructure::Expect;
+
+    int indent_;
+    std::string& out_;
+    JsonStructure structure_;
+    std::string carry_;
+    std::string spaces_;
+    size_t offset_ = 0; // Bytes consumed before the current buffer, for error messages
+    std::string error_;
+
+    void newline(size_t depth) {
+        size_t width = depth * indent_;
+        if (spaces_.size() < width) spaces_.resize(width * 2, ' ');
+        out_ += '\n';
+        out_.append(spaces_.data(), width);
+    }
+
+    void colored(std::string_view color, std::string_view text) {
+        out_ += color;
+        out_ += text;
+        out_ += RESET;
+    }
+
+    // Consumes as many complete tokens as possible and returns the number of bytes used
+    size_t process(std::string_view buf, bool final) {
+        size_t pos = 0, begin = 0;
+        while (true) {
+            JsonToken tok = JsonTokenizer::next(buf, pos, begin, final);
+            if (tok == JsonToken::NEED_MORE || tok == JsonToken::END) { offset_ += begin; return begin; }
+            if (!emit(tok, buf.substr(begin, pos - begin))) {
+                error_ = "unexpected token at byte " + std::to_string(offset_ + begin);
+                return begin;
+            }
+        }
+    }
+
+    bool emit(JsonToken tok, std::string_view text) {
+        Expect before = structure_.expect();
+        size_t depth = structure_.depth();
+        bool in_object = structure_.in_object();
+        if (!structure_.accept(tok, text[0])) return false;
+        // The highlighter may see input that never went through validate_json()
+        if (tok == JsonToken::NUMBER && !JsonTokenizer::valid_number(text)) return false;
+        if (tok == JsonToken::STRING && !JsonTokenizer::valid_string(text)) return false;
+        switch (tok) {
+            case JsonToken::COMMA: out_ += ','; return true;
+            case JsonToken::COLON: out_ += ": "; return true;
+            case JsonToken::END_OBJECT:
+            case JsonToken::END_ARRAY:
+                // Empty containers stay on one line
+                if (before == Expect::COMMA_OR_END) newline(depth - 1);
+                out_ += text;
+                return true;
+            default:
+                break;
+        }
+        if (tok == JsonToken::STRING && (before == Expect::KEY_OR_END || before == Expect::KEY)) {
+            newline(depth);
+            colored(KEY_COLOR, text);
+            return true;
+        }
+        if (before == Expect::DONE) out_ += '\n';
+        else if (depth > 0 && !in_object) newline(depth);
+        switch (tok) {
+            case JsonToken::STRING: colored(STRING_COLOR, text); break;
+            case JsonToken::NUMBER: colored(NUMBER_COLOR, text); break;
+            case JsonToken::LITERAL: colored(text[0] == 'n' ? NULL_COLOR : BOOL_COLOR, text); break;
+            default: out_ += text; break;
+        }
+        return true;
+    }
+};
+
+/**
+ * @brief Formats JSON input with proper indentation and syntax highlighting, respecting terminal width.
+ *
+ * The input is the fully read buffer: detection, --select and the prompt
+ * summary need all of it anyway, so it is highlighted in a single feed().
+ * @param input The raw JSON string.
+ * @param terminal_width The width of the terminal in characters.
+ * @return A formatted JSON string or an error message if invalid.
+ */
+std::string format_json(const std::string& input, int terminal_width) {
+    // Adjust indentation based on terminal width (e.g., use 2 spaces if terminal is narrow)
+    int indent = terminal_width < 100 ? 2 : 4;
+    std::string out;
+    out.reserve(input.size() * 2);
+    JsonHighlighter highlighter(indent, out);
+    if (!highlighter.feed(input) || !highlighter.finish()) {
+        return "Error: Invalid JSON ─ " + highlighter.error();
+    }
+    return out;
+}
+
+// One step of a --select path expression
+struct PathSegment {
+    enum class Kind { KEY, INDEX, ITERATE } kind;
+    std::string key;
+    size_t index = 0;
+};
+
+/**
+ * @brief Parses a jq-style path such as `.items[].status` or `.data["a b"][0]`.
+ * @param expr The expression; `.` selects the whole document.
+ * @return The path segments; throws std::runtime_error on syntax errors.
+ */
+std::vector<PathSegment> parse_select(const std::string& expr) {
+    std::vector<PathSegment> path;
+    size_t i = 0;
+    auto fail = [&](const std::string& what) -> void {
+        throw std::runtime_error("Invalid --select expression '" + expr + "': " + what + " at offset " + std::to_string(i));
+    };
+    auto quoted = [&]() {
+        size_t end = i + 1;
+        while (end < expr.size() && expr[end] != '"') end += expr[end] == '\\' ? 2 : 1;
+        if (end >= expr.size()) fail("unterminated string");
+        std::string key = nlohmann::json::parse(expr.substr(i, end - i + 1)).get<std::string>();
+        i = end + 1;
+        return key;
+    };
+    if (expr.empty() || (expr[0] != '.' && expr[0] != '[')) fail("expected '.' or '['");
+    while (i < expr.size()) {
+        if (expr[i] == '.') {
+            ++i;
+            if (i < expr.size() && expr[i] == '"') {
+                path.push_back({PathSegment::Kind::KEY, quoted()});
+            } else if (i < expr.size() && expr[i] != '[' && expr[i] != '.') {
+                size_t end = expr.find_first_of(".[", i);
+                if (end == std::string::npos) end = expr.size();
+                path.push_back({PathSegment::Kind::KEY, expr.substr(i, end - i)});
+                i = end;
+            } else if (i < expr.size() && expr[i] == '.') {
+                fail("empty key");
+            }
+        } else if (expr[i] == '[') {
+            ++i;
+            if (i < expr.size() && expr[i] == ']') {
+                path.push_back({PathSegment::Kind::ITERATE, {}});
+            } else if (i < expr.size() && expr[i] == '"') {
+                path.push_back({PathSegment::Kind::KEY, quoted()});
+            } else {
+                size_t end = expr.find(']', i);
+                std::string digits = expr.substr(i, end == std::string::npos ? std::string::npos : end - i);
+                if (end == std::string::npos || digits.empty() || digits.find_first_not_of("0123456789") != std::string::npos) fail("expected an index");
+                path.push_back({PathSegment::Kind::INDEX, {}, std::stoul(digits)});
+                i = end;
+            }
+            if (i >= expr.size() || expr[i] != ']') fail("expected ']'");
+            ++i;
+        } else {
+            fail("unexpected character");
+        }
+    }
+    return path;
+}
+
+/**
+ * @brief Skips one JSON value without tokenizing the inside of containers.
+ *
+ * Containers are crossed with a bracket-depth scan that only stops at quote
+ * and bracket bytes, which is the structural scan used to skip unselected
+ * subtrees and to find array element boundaries.
+ * @param buf The JSON text.
+ * @param pos Offset at or before the value (leading whitespace is skipped).
+ * @return Offset just past the value; throws std::runtime_error if malformed.
+ */
+size_t skip_json_value(std::string_view buf, size_t pos) {
+    size_t begin;
+    JsonToken tok = JsonTokenizer::next(buf, pos, begin, true);
+    if (tok == JsonToken::STRING || tok == JsonToken::NUMBER || tok == JsonToken::LITERAL) return pos;
+    if (tok != JsonToken::BEGIN_OBJECT && tok != JsonToken::BEGIN_ARRAY) {
+        throw std::runtime_error("malformed JSON near byte " + std::to_string(begin));
+    }
+    static const auto special = [] {
+        std::array<bool, 256> t{};
+        for (unsigned char c : std::string_view("\"{}[]")) t[c] = true;
+        return t;
+    }();
+    size_t depth = 1;
+    const size_t n = buf.size();
+    while (depth > 0) {
+        while (pos < n && !special[static_cast<unsigned char>(buf[pos])]) ++pos;
+        if (pos >= n) throw std::runtime_error("unexpected end of JSON input");
+        char c = buf[pos];
+        if (c == '"') {
+            if (JsonTokenizer::next(buf, pos, begin, true) != JsonToken::STRING) {
+                throw std::runtime_error("unterminated string near byte " + std::to_string(begin));
+            }
+            continue;
+        }
+        depth += (c == '{' || c == '[') ? 1 : -1;
+        ++pos;
+    }
+    return pos;
+}
+
+/**
+ * @brief Evaluates a path over raw JSON text during a single tokenizer pass.
+ *
+ * Only the selected values are cut out of the buffer (as views); every other
+ * subtree is skipped with a byte-level bracket/quote scan without being
+ * tokenized or materialized.
+ */
+class JsonSelector {
+public:
+    JsonSelector(std::string_view buf, const std::vector<PathSegment>& path) : buf_(buf), path_(path) {}
+
+    /**
+     * @brief Runs the selection.
+     * @return Views into the buffer for each selected value, in document order; throws std::runtime_error if malformed.
+     */
+    std::vector<std::string_view> run() {
+        std::vector<std::string_view> matches;
+        select(0, matches);
+        size_t begin;
+        if (JsonTokenizer::next(buf_, pos_, begin, true) != JsonToken::END) fail();
+        return matches;
+    }
+
+private:
+    std::string_view buf_;
+    const std::vector<PathSegment>& path_;
+    size_t pos_ = 0;
+
+    [[noreturn]] void fail() const {
+        throw std::runtime_error("malformed JSON near byte " + std::to_string(pos_));
+    }
+
+    JsonToken next(size_t& begin) {
+        JsonToken tok = JsonTokenizer::next(buf_, pos_, begin, true);
+        if (tok == JsonToken::INVALID || tok == JsonToken::END) fail();
+        return tok;
+    }
+
+    void expect(JsonToken want) {
+        size_t begin;
+        if (next(begin) != want) fail();
+    }
+
+    // Skips one value, jumping over nested containers with a quote-aware bracket scan
+    void skip_value() {
+        pos_ = skip_json_value(buf_, pos_);
+    }
+
+    static bool key_equals(std::string_view token, const std::string& key) {
+        std::string_view raw = token.substr(1, token.size() - 2);
+        if (raw.find('\\') == std::string_view::npos) return raw == key;
+        return nlohmann::json::parse(token).get<std::string>() == key;
+    }
+
+    // Walks the members/elements of the container at pos_, selecting or skipping each one
+    void select_children(JsonToken open, size_t depth, std::vector<std::string_view>& matches) {
+        const PathSegment& seg = path_[depth];
+        bool is_object = open == JsonToken::BEGIN_OBJECT;
+        JsonToken close = is_object ? JsonToken::END_OBJECT : JsonToken::END_ARRAY;
+        size_t index = 0;
+        size_t begin;
+        size_t save = pos_;
+        if (next(begin) == close) return;
+        pos_ = save;
+        while (true) {
+            bool wanted = seg.kind == PathSegment::Kind::ITERATE;
+            if (is_object) {
+                if (next(begin) != JsonToken::STRING) fail();
+                if (seg.kind == PathSegment::Kind::KEY) wanted = key_equals(buf_.substr(begin, pos_ - begin), seg.key);
+                expect(JsonToken::COLON);
+            } else if (seg.kind == PathSegment::Kind::INDEX) {
+                wanted = index == seg.index;
+            }
+            if (wanted) select(depth + 1, matches);
+            else skip_value();
+            ++index;
+            JsonToken tok = next(begin);
+            if (tok == close) return;
+            if (tok != JsonToken::COMMA) fail();
+        }
+    }
+
+    void select(size_t depth, std::vector<std::string_view>& matches) {
+        if (depth == path_.size()) {
+            size_t start = pos_;
+            skip_value();
+            start = buf_.find_first_not_of(" \t\r\n", start);
+            matches.push_back(buf_.substr(start, pos_ - start));
+            return;
+        }
+        size_t save = pos_;
+        size_t begin;
+        JsonToken tok = next(begin);
+        const PathSegment& seg = path_[depth];
+        bool applies = (tok == JsonToken::BEGIN_OBJECT && seg.kind != PathSegment::Kind::INDEX) ||
+                       (tok == JsonToken::BEGIN_ARRAY && seg.kind != PathSegment::Kind::KEY);
+        if (applies) {
+            select_children(tok, depth, matches);
+        } else {
+            pos_ = save;
+            skip_value();
+        }
+    }
+};
+
+/**
+ * @brief Applies a path to a DOM value (used for YAML documents).
+ * @param j The value to select from.
+ * @param path The parsed path.
+ * @param depth Index of the next segment to apply.
+ * @param out Receives the selected values in document order.
+ */
+void select_dom(const YamlDocument& j, const std::vector<PathSegment>& path, size_t depth, std::vector<YamlDocument>& out) {
+    if (depth == path.size()) {
+        out.push_back(j);
+        return;
+    }
+    const PathSegment& seg = path[depth];
+    if (seg.kind == PathSegment::Kind::KEY && j.is_object()) {
+        auto it = j.find(seg.key);
+        if (it != j.end()) select_dom(*it, path, depth + 1, out);
+    } else if (seg.kind == PathSegment::Kind::INDEX && j.is_array()) {
+        if (seg.index < j.size()) select_dom(j[seg.index], path, depth + 1, out);
+    } else if (seg.kind == PathSegment::Kind::ITERATE && (j.is_array() || j.is_object())) {
+        for (const auto& child : j) select_dom(child, path, depth + 1, out);
+    }
+}
+
+/**
+ * @brief Returns true if the path can select more than one value.
+ */
+bool selects_many(const std::vector<PathSegment>& path) {
+    return std::any_of(path.begin(), path.end(), [](const PathSegment& s) { return s.kind == PathSegment::Kind::ITERATE; });
+}
+
+/**
+ * @brief Selects part of a JSON document by streaming over its text.
+ * @param input The raw JSON text.
+ * @param path The parsed path.
+ * @return The selected value as JSON text (an array when the path iterates, `null` if nothing matched).
+ */
+std::string select_json(const std::string& input, const std::vector<PathSegment>& path) {
+    std::vector<std::string_view> matches = JsonSelector(input, path).run();
+    if (!selects_many(path)) return matches.empty() ? "null" : std::string(matches[0]);
+    std::string out = "[";
+    for (size_t i = 0; i < matches.size(); ++i) {
+        if (i > 0) out += ',';
+        out += matches[i];
+    }
+    return out + "]";
+}
+
+/**
+ * @brief Compact read-only JSON DOM stored as a flat tape of 12-byte nodes.
+ *
+ * Strings and numbers are not copied: a node records the byte offset of the
+ * raw (still escaped) token in the input buffer, which must outlive the tape.
+ * Containers record the index one past their last descendant so whole
+ * subtrees can be skipped in O(1). Object keys are interned, so a key repeated
+ * across thousands of array elements is stored once. The tape backs the
+ * prompt summary; highlighting streams tokens and --select cuts the raw
+ * text, so neither needs a DOM.
+ */
+class JsonTape {
+public:
+    enum class Kind : uint8_t { OBJECT, ARRAY, STRING, NUMBER, TRUE_VALUE, FALSE_VALUE, NULL_VALUE };
+    static constexpr uint32_t NO_KEY = UINT32_MAX;
+
+    explicit JsonTape(std::pmr::memory_resource* arena = std::pmr::get_default_resource())
+        : nodes_(arena), keys_(arena), key_ids_(arena) {}
+
+    /**
+     * @brief Builds the tape for a JSON text (object, array or scalar).
+     * @param input The JSON text; referenced, not copied.
+     * @param arena Memory resource for the tape and key table.
+     * @return The tape; throws std::runtime_error if the text is malformed.
+     */
+    static JsonTape parse(std::string_view input, std::pmr::memory_resource* arena = std::pmr::get_default_resource()) {
+        JsonTape tape(arena);
+        tape.input_ = input;
+        tape.nodes_.reserve(input.size() / 16 + 16);
+        tape.append(input, 0, input.size(), false, nullptr);
+        return tape;
+    }
+
+    /**
+     * @brief Builds the tape, parsing the elements of a large top-level array in parallel.
+     *
+     * The bulk array (the root array, or the largest array member of the root
+     * object such as `items`) is split at element boundaries found with a
+     * structural scan. Each worker parses its share of elements into its own
+     * tape and arena; the parts are then stitched into the final tape, remapping
+     * interned keys and shifting subtree indices. Small inputs are parsed serially.
+     * @param input The JSON text; referenced, not copied.
+     * @param workers Parallelism of the scheduler the groups run on.
+     * @param arena Memory resource for the final tape.
+     * @return The tape; throws std::runtime_error if the text is malformed.
+     */
+    static JsonTape parse_parallel(std::string_view input, unsigned workers, std::pmr::memory_resource* arena = std::pmr::get_default_resource()) {
+        const size_t min_parallel_bytes = 16 << 20;
+        size_t at = 0, end = 0;
+        if (workers < 2 || input.size() < min_parallel_bytes || !find_bulk_array(input, at, end)) return parse(input, arena);
+
+        // Element boundaries of the bulk array, grouped into byte-balanced ranges
+        std::vector<std::pair<size_t, size_t>> groups;
+        size_t target = (end - at) / (workers * 4) + 1; // Several groups per worker so idle workers can steal
+        size_t pos = at + 1, group_start = SIZE_MAX, begin = 0;
+        while (true) {
+            JsonToken tok = JsonTokenizer::next(input, pos, begin, true);
+            if (tok == JsonToken::END_ARRAY && group_start == SIZE_MAX && groups.empty()) break;
+            if (group_start == SIZE_MAX) group_start = begin;
+            pos = skip_json_value(input, begin);
+            size_t value_end = pos;
+            tok = JsonTokenizer::next(input, pos, begin, true);
+            if (tok == JsonToken::END_ARRAY || value_end - group_start >= target) {
+                groups.emplace_back(group_start, value_end);
+                group_start = SIZE_MAX;
+            }
+            if (tok == JsonToken::END_ARRAY) break;
+            if (tok != JsonToken::COMMA) throw std::runtime_error("malformed JSON near byte " + std::to_string(begin));
+        }
+        if (groups.size() < 2) return parse(input, arena);
+
+        // Parse each group into its own tape backed by a per-thread arena
+        std::vector<std::unique_ptr<std::pmr::monotonic_buffer_resource>> arenas;
+        std::vector<JsonTape> parts;
+        for (size_t g = 0; g < groups.size(); ++g) {
+            arenas.push_back(std::make_unique<std::pmr::monotonic_buffer_resource>());
+            parts.emplace_back(arenas.back().get());
+            parts.back().input_ = input;
+        }
+        Scheduler::global().parallel_for(groups.size(), [&](size_t g) {
+            parts[g].nodes_.reserve((groups[g].second - groups[g].first) / 16 + 16);
+            parts[g].append(input, groups[g].first, groups[g].second, true, nullptr);
+        });
+
+        // Stitch: parse the document around the bulk array and splice the parts in
+        JsonTape tape(arena);
+        tape.input_ = input;
+        auto splice = [&](JsonTape& t) {
+            std::vector<size_t> base(parts.size());
+            std::vector<std::vector<uint32_t>> key_map(parts.size());
+            size_t total = t.nodes_.size();
+            for (size_t g = 0; g < parts.size(); ++g) {
+                base[g] = total;
+                total += parts[g].nodes_.size();
+                for (std::string_view name : parts[g].keys_) key_map[g].push_back(t.intern(name));
+            }
+            t.nodes_.resize(total);
+            Scheduler::global().parallel_for(parts.size(), [&](size_t g) {
+                Node* out = t.nodes_.data() + base[g];
+                for (const Node& n : parts[g].nodes_) {
+                    Node copy = n;
+                    if (copy.key != NO_KEY) copy.key = key_map[g][copy.key];
+                    if (copy.kind() == Kind::OBJECT || copy.kind() == Kind::ARRAY) copy.set_payload(copy.payload() + base[g]);
+                    *out++ = copy;
+                }
+            });
+        };
+        tape.nodes_.reserve(input.size() / 16 + 16);
+        Splice bulk{at, end, splice};
+        tape.append(input, 0, input.size(), false, &bulk);
+        return tape;
+    }
+
+    size_t size() const { return nodes_.size(); }
+    size_t key_count() const { return keys_.size(); }
+    Kind kind(size_t i) const { return nodes_[i].kind(); }
+    bool is_container(size_t i) const { return kind(i) == Kind::OBJECT || kind(i) == Kind::ARRAY; }
+
+    // Index of the node following node i and all its descendants
+    size_t next(size_t i) const { return is_container(i) ? nodes_[i].payload() : i + 1; }
+
+    // Raw (escaped) key of an object member, without quotes; empty for array elements
+    std::string_view key(size_t i) const {
+        uint32_t k = nodes_[i].key;
+        return k == NO_KEY ? std::string_view() : keys_[k];
+    }
+
+    // Raw token text of a scalar node, including quotes for strings
+    std::string_view raw(size_t i) const {
+        size_t pos = nodes_[i].payload(), begin = pos;
+        JsonTokenizer::next(input_, pos, begin, true);
+        return input_.substr(begin, pos - begin);
+    }
+
+    /**
+     * @brief Serializes node i as compact JSON, pruning large arrays and strings like prune_json().
+     * @param i The node to write.
+     * @param max_items Maximum elements kept per array.
+     * @param max_string Maximum raw length of string values.
+     * @param budget Output size limit; writing stops early once it is exceeded.
+     * @param out Destination string.
+     * @return False if the budget was exceeded.
+     */
+    bool write_compact(size_t i, size_t max_items, size_t max_string, size_t budget, std::string& out) const {
+        if (out.size() > budget) return false;
+        Kind k = kind(i);
+        if (k == Kind::OBJECT || k == Kind::ARRAY) {
+            bool object = k == Kind::OBJECT;
+            out += object ? '{' : '[';
+            size_t end = next(i), count = 0, total = 0;
+            for (size_t c = i + 1; c < end; c = next(c), ++total) {
+                if (object) {
+                    std::string_view name = key(c);
+                    if (is_pruned_key(name)) continue;
+                    if (count > 0) out += ',';
+                    out += '"';
+                    out += name;
+                    out += "\":";
+                } else {
+                    if (count >= max_items) continue;
+                    if (count > 0) out += ',';
+                }
+                ++count;
+                if (!write_compact(c, max_items, max_string, budget, out)) return false;
+            }
+            if (!object && total > count) {
+                out += count > 0 ? ",\"" : "\"";
+                out += elided_items(total - count) + "\"";
+            }
+            out += object ? '}' : ']';
+            return out.size() <= budget;
+        }
+        std::string_view text = raw(i);
+        if (k == Kind::STRING && text.size() - 2 > max_string) {
+            // Cut on an escape-sequence and UTF-8 boundary so the result stays valid JSON
+            std::string_view body = text.substr(1, text.size() - 2);
+            size_t cut = summary_cut(body, max_string, true);
+            out += '"';
+            out += body.substr(0, cut);
+            out += "…\"";
+        } else {
+            out += text;
+        }
+        return out.size() <= budget;
+    }
+
+private:
+    // 12-byte node: 56-bit payload (input offset or subtree end), 8-bit kind, 32-bit key id
+    struct Node {
+        uint32_t payload_low;
+        uint32_t payload_high_kind;
+        uint32_t key;
+
+        size_t payload() const { return payload_low | (static_cast<size_t>(payload_high_kind & 0xFFFFFF) << 32); }
+        Kind kind() const { return static_cast<Kind>(payload_high_kind >> 24); }
+        void set_payload(size_t p) {
+            payload_low = static_cast<uint32_t>(p);
+            payload_high_kind = (payload_high_kind & 0xFF000000u) | static_cast<uint32_t>(p >> 32);
+        }
+    };
+    static_assert(sizeof(Node) == 12, "JsonTape nodes must stay compact");
+
+    std::string_view input_;
+    std::pmr::vector<Node> nodes_;
+    std::pmr::vector<std::string_view> keys_;
+    std::pmr::unordered_map<std::string_view, uint32_t> key_ids_;
+
+    // An array whose elements are filled in by a callback instead of being tokenized
+    struct Splice {
+        size_t at;  // Offset of the array's '['
+        size_t end; // Offset just past its ']'
+        std::function<void(JsonTape&)> fill;
+    };
+
+    /**
+     * @brief Tokenizes input[pos, end) and appends its nodes.
+     * @param sequence True if the range is a comma-separated list of values (the inside of an array).
+     * @param splice Optional array whose contents are appended by a callback.
+     */
+    void append(std::string_view input, size_t pos, size_t end, bool sequence, const Splice* splice) {
+        std::string_view buf = input.substr(0, end);
+        JsonStructure structure;
+        if (sequence) structure.accept(JsonToken::BEGIN_ARRAY, '[');
+        size_t base_depth = structure.depth();
+        std::vector<uint32_t> open;
+        uint32_t key = NO_KEY;
+        size_t begin = 0;
+        while (true) {
+            JsonToken tok = JsonTokenizer::next(buf, pos, begin, true);
+            if (tok == JsonToken::END) break;
+            bool is_key = tok == JsonToken::STRING && (structure.expect() == JsonStructure::Expect::KEY ||
+                                                       structure.expect() == JsonStructure::Expect::KEY_OR_END);
+            bool closes = tok == JsonToken::END_OBJECT || tok == JsonToken::END_ARRAY;
+            std::string_view token = buf.substr(begin, pos - begin);
+            if ((closes && open.empty()) || !structure.accept(tok, buf[begin]) ||
+                (tok == JsonToken::NUMBER && !JsonTokenizer::valid_number(token)) ||
+                (tok == JsonToken::STRING && !JsonTokenizer::valid_string(token))) {
+                throw std::runtime_error("malformed JSON near byte " + std::to_string(begin));
+            }
+            switch (tok) {
+                case JsonToken::BEGIN_OBJECT:
+                case JsonToken::BEGIN_ARRAY:
+                    if (splice && begin == splice->at) {
+                        size_t index = nodes_.size();
+                        push(Kind::ARRAY, 0, key);
+                        splice->fill(*this);
+                        nodes_[index].set_payload(nodes_.size());
+                        structure.accept(JsonToken::END_ARRAY, ']');
+                        pos = splice->end;
+                        break;
+                    }
+                    open.push_back(static_cast<uint32_t>(nodes_.size()));
+                    push(tok == JsonToken::BEGIN_OBJECT ? Kind::OBJECT : Kind::ARRAY, 0, key);
+                    break;
+                case JsonToken::END_OBJECT:
+                case JsonToken::END_ARRAY:
+                    nodes_[open.back()].set_payload(nodes_.size());
+                    open.pop_back();
+                    break;
+                case JsonToken::STRING:
+                    if (is_key) {
+                        key = intern(buf.substr(begin + 1, pos - begin - 2));
+                        continue;
+                    }
+                    push(Kind::STRING, begin, key);
+                    break;
+                case JsonToken::NUMBER:
+                    push(Kind::NUMBER, begin, key);
+                    break;
+                case JsonToken::LITERAL:
+                    push(buf[begin] == 't' ? Kind::TRUE_VALUE : buf[begin] == 'f' ? Kind::FALSE_VALUE : Kind::NULL_VALUE, begin, key);
+                    break;
+                default:
+                    continue; // Colons and commas keep the pending key
+            }
+            key = NO_KEY;
+        }
+        bool complete = sequence ? structure.depth() == base_depth && structure.expect() == JsonStructure::Expect::COMMA_OR_END
+                                 : structure.complete();
+        if (!complete) throw std::runtime_error("unexpected end of JSON input");
+    }
+
+    /**
+     * @brief Finds the array that holds the bulk of the document.
+     * @param at Out: offset of its '['.
+     * @param end Out: offset just past its ']'.
+     * @return True if the root, or a member of the root object, is an array spanning most of the input.
+     */
+    static bool find_bulk_array(std::string_view input, size_t& at, size_t& end) {
+        size_t pos = 0, begin = 0;
+        JsonToken tok = JsonTokenizer::next(input, pos, begin, true);
+        if (tok == JsonToken::BEGIN_ARRAY) {
+            at = begin;
+            end = skip_json_value(input, begin);
+            return true;
+        }
+        if (tok != JsonToken::BEGIN_OBJECT) return false;
+        size_t best = 0;
+        while (true) {
+            tok = JsonTokenizer::next(input, pos, begin, true);
+            if (tok != JsonToken::STRING) return best > 0;
+            if (JsonTokenizer::next(input, pos, begin, true) != JsonToken::COLON) return false;
+            size_t value = input.find_first_not_of(" \t\r\n", pos);
+            pos = skip_json_value(input, pos);
+            if (value < input.size() && input[value] == '[' && pos - value > best) {
+                best = pos - value;
+                at = value;
+                end = pos;
+            }
+            tok = JsonTokenizer::next(input, pos, begin, true);
+            if (tok != JsonToken::COMMA) break;
+        }
+        return best > input.size() / 2;
+    }
+
+    void push(Kind kind, size_t payload, uint32_t key) {
+        Node n{0, static_cast<uint32_t>(kind) << 24, key};
+        n.set_payload(payload);
+        nodes_.push_back(n);
+    }
+
+    uint32_t intern(std::string_view name) {
+        auto [it, inserted] = key_ids_.try_emplace(name, static_cast<uint32_t>(keys_.size()));
+        if (inserted) keys_.push_back(name);
+        return it->second;
+    }
+};
+
+/**
+ * @brief Produces the minified prompt representation of a JSON text via the compact tape.
+ *
+ * Each pruning attempt stops as soon as the output exceeds the budget and
+ * skips elided subtrees in O(1), so the cost is bounded by the budget rather
+ * than the document size.
+ * @param tape The parsed document.
+ * @return Compact JSON of at most roughly SUMMARY_BUDGET bytes.
+ */
+std::string summarize_json(const JsonTape& tape) {
+    return summarize_within_budget([&](size_t max_items, size_t max_string, std::string& out) {
+        return tape.write_compact(0, max_items, max_string, SUMMARY_BUDGET, out);
+    });
+}
+
+/**
+ * @brief Detects the format of the input data (JSON, YAML, Table, or Plain Text).
+ * @param input The input string to analyze.
+ * @param arena Memory resource for temporary parser state.
+ * @param free_text_tail The input is ps-style output (from fingerprint_command()): rows may have
+ *                       more fields than the header, the extra ones belonging to the last column.
+ * @param yaml_documents Out (optional): the parsed documents when the input is YAML, so the
+ *                       detection parse is also the one the DOM comes from.
+ * @return The detected Format (JSON, YAML, TABLE, or PLAIN_TEXT).
+ */
+Format detect_format(const std::string& input, std::pmr::memory_resource* arena = std::pmr::get_default_resource(),
+                     bool free_text_tail = false, std::vector<YamlDocument>* yaml_documents = nullptr) {
+    if (input.empty()) return Format::PLAIN_TEXT;
+
+    // Check for a JSON object or array with a structural token scan (no DOM)
+    if (validate_json(input)) {
+        return Format::JSON;
+    }
+
+    // Attempt to parse input as YAML when its leading lines look like block YAML; the DOM is kept for rendering
+    if (looks_like_yaml(input)) {
+        try {
+            std::vector<YamlDocument> documents = parse_yaml(input, arena);
+            if (!documents.empty() && documents.front().is_structured()) {
+                if (yaml_documents) *yaml_documents = std::move(documents);
+                return Format::YAML;
+            }
+        } catch (...) {}
+    }
+
+    // Check for table structure by verifying consistent column counts, counting fields in place
+    size_t rows = 0, columns = 0;
+    bool is_table = true;
+    for (size_t start = 0; start < input.size();) {
+        size_t end = input.find('\n', start);
+        if (end == std::string::npos) end = input.size();
+        size_t fields = 0;
+        bool in_field = false;
+        for (size_t i = start; i < end; ++i) {
+            bool space = std::isspace(static_cast<unsigned char>(input[i]));
+            if (!space && !in_field) ++fields;
+            in_field = !space;
+        }
+        start = end + 1;
+        if (rows++ == 0) {
+            columns = fields;
+        } else if (fields != columns && !(free_text_tail && fields > columns)) {
+            is_table = false;
+            break;
+        }
+    }
+    if (is_table && rows > 1 && columns > 1) {
+        return Format::TABLE;
+    }
+
+    return Format::PLAIN_TEXT;
+}
+
+/**
+ * @brief Writes a JSON value as block-style YAML.
+ * @param j The value to render.
+ * @param indent Current indentation in spaces.
+ * @param out Destination string.
+ */
+void render_yaml(const YamlDocument& j, int indent, std::string& out) {
+    auto scalar = [](const YamlDocument& v) {
+        if (!v.is_string()) return v.dump();
+        const std::string& s = v.get_ref<const std::string&>();
+        bool plain = !s.empty() && s.find_first_of(":#\n\"'{}[],&*!|>%@`") == std::string::npos &&
+                     s.front() != ' ' && s.back() != ' ' && s.front() != '-' &&
+                     s != "true" && s != "false" && s != "null" && s != "~" &&
+                     s.find_first_not_of("+-.0123456789eE") != std::string::npos;
+        return plain ? s : v.dump();
+    };
+    std::string pad(indent, ' ');
+    if (j.is_object()) {
+        for (auto it = j.begin(); it != j.end(); ++it) {
+            out += pad + it.key() + ":";
+            const YamlDocument& v = it.value();
+            if ((v.is_object() || v.is_array()) && !v.empty()) {
+                out += '\n';
+                render_yaml(v, v.is_array() ? indent : indent + 2, out);
+            } else {
+                out += ' ' + (v.is_object() ? std::string("{}") : v.is_array() ? std::string("[]") : scalar(v)) + '\n';
+            }
+        }
+    } else if (j.is_array()) {
+        for (const auto& v : j) {
+            if ((v.is_object() || v.is_array()) && !v.empty()) {
+                // Render the nested block one level deeper, then fold its first line onto the dash
+                std::string nested;
+                render_yaml(v, indent + 2, nested);
+                out += pad + "- " + nested.substr(indent + 2);
+            } else {
+                out += pad + "- " + (v.is_object() ? std::string("{}") : v.is_array() ? std::string("[]") : scalar(v)) + '\n';
+            }
+        }
+    } else {
+        out += pad + scalar(j) + '\n';
+    }
+}
+
+/**
+ * @brief Formats parsed YAML documents as normalized block YAML.
+ * @param docs The documents of the stream, in order.
+ * @return The rendered stream, documents separated by `---`.
+ */
+std::string format_yaml(const std::vector<YamlDocument>& docs) {
+    std::string out;
+    for (size_t i = 0; i < docs.size(); ++i) {
+        if (i > 0) out += "---\n";
+        render_yaml(docs[i], 0, out);
+    }
+    if (!out.empty() && out.back() == '\n') out.pop_back();
+    return out;
+}
+
+/**
+ * @brief Returns the offset of the first non-ASCII byte at or after i (n if none).
+ *
+ * Skips 16 bytes at a time with SSE2, 8 with a portable word-at-a-time loop elsewhere.
+ */
+size_t skip_ascii(const unsigned char* p, size_t i, size_t n) {
+#if defined(__SSE2__)
+    while (i + 16 <= n && !_mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i)))) i += 16;
+#else
+    uint64_t w;
+    while (i + 8 <= n && (std::memcpy(&w, p + i, 8), !(w & 0x8080808080808080ULL))) i += 8;
+#endif
+    while (i < n && p[i] < 0x80) ++i;
+    return i;
+}
+
+/**
+ * @brief Checks whether a byte range is pure ASCII.
+ *
+ * Uses the vectorized skip_ascii() scan, so callers can fall back to byte
+ * length on ASCII-heavy input at close to memory bandwidth.
+ * @param s The bytes to check.
+ * @return True if no byte has its high bit set.
+ */
+bool is_ascii(std::string_view s) {
+    return skip_ascii(reinterpret_cast<const unsigned char*>(s.data()), 0, s.size()) == s.size();
+}
+
+/**
+ * @brief Returns the length of the well-formed UTF-8 sequence at p, or 0 if it is invalid or truncated.
+ *
+ * Rejects overlong forms, surrogates and code points above U+10FFFF.
+ */
+size_t utf8_sequence_length(const unsigned char* p, size_t n) {
+    unsigned char c = p[0];
+    if (c < 0x80) return 1;
+    auto cont = [&](size_t k, unsigned char lo = 0x80, unsigned char hi = 0xBF) { return k < n && p[k] >= lo && p[k] <= hi; };
+    if (c >= 0xC2 && c <= 0xDF) return cont(1) ? 2 : 0;
+    if (c >= 0xE0 && c <= 0xEF) {
+        unsigned char lo = c == 0xE0 ? 0xA0 : 0x80, hi = c == 0xED ? 0x9F : 0xBF;
+        return cont(1, lo, hi) && cont(2) ? 3 : 0;
+    }
+    if (c >= 0xF0 && c <= 0xF4) {
+        unsigned char lo = c == 0xF0 ? 0x90 : 0x80, hi = c == 0xF4 ? 0x8F : 0xBF;
+        return cont(1, lo, hi) && cont(2) && cont(3) ? 4 : 0;
+    }
+    return 0;
+}
+
+/**
+ * @brief Finds the first byte that does not start a well-formed UTF-8 sequence.
+ *
+ * ASCII runs are skipped with skip_ascii(); only non-ASCII sequences are decoded.
+ * @param s The text to validate.
+ * @return Offset of the first invalid byte, or std::string_view::npos if the text is valid.
+ */
+size_t find_invalid_utf8(std::string_view s) {
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(s.data());
+    const size_t n = s.size();
+    size_t i = 0;
+    while (i < n) {
+        i = skip_ascii(p, i, n);
+        if (i >= n) break;
+        size_t len = utf8_sequence_length(p + i, n - i);
+        if (len == 0) return i;
+        i += len;
+    }
+    return std::string_view::npos;
+}
+
+/**
+ * @brief Validates UTF-8 and replaces invalid sequences with U+FFFD.
+ *
+ * Valid input is only scanned; on the first error the valid prefix is copied
+ * and the rest is repaired in the same pass, so the text is never scanned
+ * twice and later JSON serialization cannot fail on it.
+ * @param text The text to check; replaced by the repaired text if needed.
+ * @return The number of replacement characters inserted.
+ */
+size_t repair_utf8(std::string& text) {
+    size_t bad = find_invalid_utf8(text);
+    if (bad == std::string_view::npos) return 0;
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(text.data());
+    const size_t n = text.size();
+    std::string out;
+    out.reserve(n + n / 16);
+    out.append(text, 0, bad);
+    size_t replaced = 0;
+    for (size_t i = bad; i < n;) {
+        size_t run = skip_ascii(p, i, n);
+        out.append(text, i, run - i);
+        i = run;
+        if (i >= n) break;
+        size_t len = utf8_sequence_length(p + i, n - i);
+        if (len > 0) {
+            out.append(text, i, len);
+            i += len;
+        } else {
+            out += "\xEF\xBF\xBD";
+            ++replaced;
+            ++i;
+        }
+    }
+    text.swap(out);
+    return replaced;
+}
+
+/**
+ * @brief Classifies input as binary from a sample of its first bytes.
+ *
+ * Counts NUL bytes and control bytes other than common whitespace and ESC
+ * (16 bytes per step with SSE2), then checks UTF-8 well-formedness of the
+ * sample, so the decision costs a few microseconds regardless of input size.
+ * @param input The raw input.
+ * @return True if the input should not be treated as text.
+ */
+bool looks_binary(std::string_view input) {
+    const size_t sample_size = 8192;
+    std::string_view sample = input.substr(0, sample_size);
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(sample.data());
+    const size_t n = sample.size();
+    size_t nul = 0, control = 0, i = 0;
+#if defined(__SSE2__)
+    const __m128i limit = _mm_set1_epi8(0x1F);
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i tab = _mm_set1_epi8('\t'), lf = _mm_set1_epi8('\n'), cr = _mm_set1_epi8('\r'), esc = _mm_set1_epi8('\033');
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+        __m128i low = _mm_cmpeq_epi8(_mm_max_epu8(v, limit), limit); // Unsigned v <= 0x1F
+        __m128i allowed = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, tab), _mm_cmpeq_epi8(v, lf)),
+                                       _mm_or_si128(_mm_cmpeq_epi8(v, cr), _mm_cmpeq_epi8(v, esc)));
+        nul += __builtin_popcount(_mm_movemask_epi8(_mm_cmpeq_epi8(v, zero)));
+        control += __builtin_popcount(_mm_movemask_epi8(_mm_andnot_si128(allowed, low)));
+    }
+#endif
+    for (; i < n; ++i) {
+        if (p[i] == 0) ++nul;
+        if (p[i] <= 0x1F && p[i] != '\t' && p[i] != '\n' && p[i] != '\r' && p[i] != '\033') ++control;
+    }
+    if (nul > 0 || control * 10 > n) return true;
+
+    // Mostly-invalid UTF-8 (ignoring a sequence cut by the sample boundary) also means binary
+    size_t invalid = 0;
+    for (size_t k = 0; k + 4 < n;) {
+        k = skip_ascii(p, k, n);
+        if (k + 4 >= n) break;
+        size_t len = utf8_sequence_length(p + k, n - k);
+        if (len == 0) { ++invalid; ++k; } else { k += len; }
+    }
+    return invalid * 20 > n;
+}
+
+/**
+ * @brief Builds a local, `file`/`xxd`-style summary of binary input.
+ * @param input The raw binary input.
+ * @param terminal_width The width of the terminal in characters.
+ * @return Type guess from magic bytes, size, byte entropy and a hexdump of the first bytes.
+ */
+std::string format_binary(std::string_view input, int terminal_width) {
+    auto starts = [&](std::string_view magic, size_t at = 0) { return input.size() >= at + magic.size() && input.substr(at, magic.size()) == magic; };
+    std::string type = "unknown binary data";
+    if (starts("\x7F" "ELF")) {
+        uint16_t e_type = input.size() > 17 ? static_cast<unsigned char>(input[16]) | static_cast<unsigned char>(input[17]) << 8 : 0;
+        type = e_type == 4 ? "ELF core dump" : e_type == 3 ? "ELF shared object / PIE executable" : e_type == 2 ? "ELF executable" : "ELF object";
+    }
+    else if (starts("MZ")) type = "PE/DOS executable";
+    else if (starts("\xCF\xFA\xED\xFE") || starts("\xCE\xFA\xED\xFE") || starts("\xCA\xFE\xBA\xBE")) type = "Mach-O binary";
+    else if (starts("\x1F\x8B")) type = "gzip compressed data";
+    else if (starts("\x28\xB5\x2F\xFD")) type = "zstd compressed data";
+    else if (starts(std::string_view("\xFD" "7zXZ\0", 6))) type = "xz compressed data";
+    else if (starts("BZh")) type = "bzip2 compressed data";
+    else if (starts(std::string_view("PK\x03\x04", 4))) type = "zip archive (or jar/docx/xlsx)";
+    else if (starts("ustar", 257)) type = "tar archive";
+    else if (starts("\x89PNG")) type = "PNG image";
+    else if (starts("\xFF\xD8\xFF")) type = "JPEG image";
+    else if (starts("GIF8")) type = "GIF image";
+    else if (starts("%PDF")) type = "PDF document";
+    else if (starts(std::string_view("SQLite format 3\0", 16))) type = "SQLite database";
+    else if (starts("\x00\x61\x73\x6D")) type = "WebAssembly module";
+
+    // Shannon entropy of the leading 64 KiB, in bits per byte
+    std::array<size_t, 256> counts{};
+    std::string_view sample = input.substr(0, 64 * 1024);
+    for (unsigned char c : sample) ++counts[c];
+    double entropy = 0;
+    for (size_t c : counts) {
+        if (c == 0) continue;
+        double f = static_cast<double>(c) / sample.size();
+        entropy -= f * std::log2(f);
+    }
+
+    std::ostringstream ss;
+    double size = static_cast<double>(input.size());
+    const char* units[] = {"B", "KiB", "MiB", "GiB", "TiB"};
+    size_t unit = 0;
+    while (size >= 1024 && unit < 4) { size /= 1024; ++unit; }
+    ss << "\033[1mBinary input\033[0m: \033[33m" << type << "\033[0m\n"
+       << "  Size:    " << std::fixed << std::setprecision(unit ? 1 : 0) << size << ' ' << units[unit] << " (" << input.size() << " bytes)\n"
+       << "  Entropy: " << std::setprecision(2) << entropy << " bits/byte"
+       << (entropy > 7.5 ? " (compressed or encrypted)" : entropy < 5 ? " (structured/sparse)" : "") << "\n\n";
+
+    // Hexdump of the first bytes, 16 per row on wide terminals
+    size_t per_row = terminal_width >= 78 ? 16 : 8;
+    std::string_view head = input.substr(0, per_row * 16);
+    for (size_t off = 0; off < head.size(); off += per_row) {
+        ss << "\033[34m" << std::hex << std::setw(8) << std::setfill('0') << off << "\033[0m  ";
+        for (size_t k = 0; k < per_row; ++k) {
+            if (off + k < head.size()) ss << std::setw(2) << static_cast<unsigned>(static_cast<unsigned char>(head[off + k])) << ' ';
+            else ss << "   ";
+        }
+        ss << ' ';
+        for (size_t k = 0; k < per_row && off + k < head.size(); ++k) {
+            unsigned char c = static_cast<unsigned char>(head[off + k]);
+            ss << (c >= 0x20 && c < 0x7F ? static_cast<char>(c) : '.');
+        }
+        ss << std::dec << std::setfill(' ') << '\n';
+    }
+    if (input.size() > head.size()) ss << "  … " << input.size() - head.size() << " more bytes\n";
+    return ss.str();
+}
+
+/**
+ * @brief Decodes one UTF-8 code point.
+ * @param s The UTF-8 text.
+ * @param i In: offset of the lead byte. Out: offset of the next code point.
+ * @return The code point, or U+FFFD for an invalid or truncated sequence (consuming one byte).
+ */
+char32_t decode_utf8(std::string_view s, size_t& i) {
+    unsigned char c = static_cast<unsigned char>(s[i]);
+    if (c < 0x80) { ++i; return c; }
+    size_t len = c >= 0xF0 ? 4 : c >= 0xE0 ? 3 : c >= 0xC2 ? 2 : 0;
+    if (len == 0 || c > 0xF4 || i + len > s.size()) { ++i; return 0xFFFD; }
+    char32_t cp = c & (0x7F >> len);
+    for (size_t k = 1; k < len; ++k) {
+        unsigned char cc = static_cast<unsigned char>(s[i + k]);
+        if ((cc & 0xC0) != 0x80) { ++i; return 0xFFFD; }
+        cp = (cp << 6) | (cc & 0x3F);
+    }
+    i += len;
+    return cp;
+}
+
+// Inclusive code point range used by the display-width tables
+struct CodepointRange {
+    char32_t first;
+    char32_t last;
+};
+
+// Combining marks, joiners, variation selectors and other code points that occupy no cell
+constexpr CodepointRange ZERO_WIDTH_RANGES[] = {
+    {0x0300, 0x036F}, {0x0483, 0x0489}, {0x0591, 0x05BD}, {0x05BF, 0x05BF}, {0x05C1, 0x05C2},
+    {0x05C4, 0x05C5}, {0x05C7, 0x05C7}, {0x0610, 0x061A}, {0x064B, 0x065F}, {0x0670, 0x0670},
+    {0x06D6, 0x06DC}, {0x06DF, 0x06E4}, {0x06E7, 0x06E8}, {0x06EA, 0x06ED}, {0x0900, 0x0902},
+    {0x093A, 0x093A}, {0x093C, 0x093C}, {0x0941, 0x0948}, {0x094D, 0x094D}, {0x0951, 0x0957},
+    {0x0E31, 0x0E31}, {0x0E34, 0x0E3A}, {0x0E47, 0x0E4E}, {0x1AB0, 0x1AFF}, {0x1DC0, 0x1DFF},
+    {0x200B, 0x200F}, {0x202A, 0x202E}, {0x2060, 0x2064}, {0x20D0, 0x20FF}, {0xFE00, 0xFE0F},
+    {0xFE20, 0xFE2F}, {0xFEFF, 0xFEFF}, {0x1F3FB, 0x1F3FF}, {0xE0000, 0xE007F}, {0xE0100, 0xE01EF},
+};
+
+// East Asian Wide/Fullwidth blocks and emoji presentation code points that occupy two cells
+constexpr CodepointRange WIDE_RANGES[] = {
+    {0x1100, 0x115F}, {0x231A, 0x231B}, {0x2329, 0x232A}, {0x23E9, 0x23EC}, {0x23F0, 0x23F0},
+    {0x23F3, 0x23F3}, {0x25FD, 0x25FE}, {0x2614, 0x2615}, {0x2648, 0x2653}, {0x267F, 0x267F},
+    {0x2693, 0x2693}, {0x26A1, 0x26A1}, {0x26AA, 0x26AB}, {0x26BD, 0x26BE}, {0x26C4, 0x26C5},
+    {0x26CE, 0x26CE}, {0x26D4, 0x26D4}, {0x26EA, 0x26EA}, {0x26F2, 0x26F3}, {0x26F5, 0x26F5},
+    {0x26FA, 0x26FA}, {0x26FD, 0x26FD}, {0x2705, 0x2705}, {0x270A, 0x270B}, {0x2728, 0x2728},
+    {0x274C, 0x274C}, {0x274E, 0x274E}, {0x2753, 0x2755}, {0x2757, 0x2757}, {0x2795, 0x2797},
+    {0x27B0, 0x27B0}, {0x27BF, 0x27BF}, {0x2B1B, 0x2B1C}, {0x2B50, 0x2B50}, {0x2B55, 0x2B55},
+    {0x2E80, 0x303E}, {0x3041, 0x33FF}, {0x3400, 0x4DBF}, {0x4E00, 0x9FFF}, {0xA000, 0xA4CF},
+    {0xA960, 0xA97F}, {0xAC00, 0xD7A3}, {0xF900, 0xFAFF}, {0xFE10, 0xFE19}, {0xFE30, 0xFE6F},
+    {0xFF00, 0xFF60}, {0xFFE0, 0xFFE6}, {0x16FE0, 0x16FE4}, {0x17000, 0x18CFF}, {0x1B000, 0x1B2FF},
+    {0x1F004, 0x1F004}, {0x1F0CF, 0x1F0CF}, {0x1F18E, 0x1F18E}, {0x1F191, 0x1F19A}, {0x1F200, 0x1F251},
+    {0x1F300, 0x1F64F}, {0x1F680, 0x1F6FF}, {0x1F7E0, 0x1F7EB}, {0x1F90C, 0x1F9FF}, {0x1FA70, 0x1FAFF},
+    {0x20000, 0x2FFFD}, {0x30000, 0x3FFFD},
+};
+
+template <size_t N>
+bool in_ranges(const CodepointRange (&ranges)[N], char32_t cp) {
+    auto it = std::upper_bound(std::begin(ranges), std::end(ranges), cp,
+                               [](char32_t v, const CodepointRange& r) { return v < r.first; });
+    return it != std::begin(ranges) && cp <= std::prev(it)->last;
+}
+
+/**
+ * @brief Returns the number of terminal cells a code point occupies (0, 1 or 2).
+ */
+int codepoint_width(char32_t cp) {
+    if (cp < 0x300) return cp < 0x20 || (cp >= 0x7F && cp < 0xA0) ? 0 : 1;
+    if (in_ranges(ZERO_WIDTH_RANGES, cp)) return 0;
+    return in_ranges(WIDE_RANGES, cp) ? 2 : 1;
+}
+
+/**
+ * @brief Advances over one grapheme cluster (base code point plus combining marks, ZWJ sequences and flag pairs).
+ * @param s The UTF-8 text.
+ * @param i In: start of the cluster. Out: start of the next cluster.
+ * @return The display width of the cluster.
+ */
+int next_grapheme(std::string_view s, size_t& i) {
+    char32_t cp = decode_utf8(s, i);
+    int width = codepoint_width(cp);
+    bool regional = cp >= 0x1F1E6 && cp <= 0x1F1FF;
+    while (i < s.size()) {
+        size_t j = i;
+        char32_t next = decode_utf8(s, j);
+        if (next == 0x200D) {
+            // Zero-width joiner glues the following code point into the same glyph
+            i = j;
+            if (i < s.size()) decode_utf8(s, i);
+        } else if (next == 0xFE0F) {
+            i = j;
+            width = std::max(width, 2); // Emoji presentation selector
+        } else if (regional && next >= 0x1F1E6 && next <= 0x1F1FF) {
+            i = j;
+            width = 2;
+            regional = false;
+        } else if (codepoint_width(next) == 0 && next >= 0x300) {
+            i = j;
+        } else {
+            break;
+        }
+    }
+    return width;
+}
+
+/**
+ * @brief Computes the number of terminal cells a UTF-8 string occupies.
+ * @param s The UTF-8 text.
+ * @return The display width; equal to the byte length for ASCII text.
+ */
+size_t display_width(std::string_view s) {
+    if (is_ascii(s)) return s.size();
+    size_t width = 0;
+    for (size_t i = 0; i < s.size();) width += next_grapheme(s, i);
+    return width;
+}
+
+/**
+ * @brief Cuts a UTF-8 string to at most `max_width` cells without splitting a grapheme cluster.
+ * @param s The UTF-8 text.
+ * @param max_width The maximum display width.
+ * @param width Out: display width of the returned prefix.
+ * @return The longest prefix that fits.
+ */
+std::string_view truncate_to_width(std::string_view s, size_t max_width, size_t& width) {
+    width = 0;
+    size_t i = 0;
+    while (i < s.size()) {
+        size_t j = i;
+        size_t w = next_grapheme(s, j);
+        if (width + w > max_width) break;
+        width += w;
+        i = j;
+    }
+    return s.substr(0, i);
+}
+
+// A stripped SGR (color/style) escape sequence and where it sat in the stripped text
+struct AnsiSpan {
+    size_t offset;        // Offset in the stripped text the sequence preceded
+    std::string sequence; // The full escape sequence, e.g. "\033[1;31m"
+};
+
+/**
+ * @brief Returns the length of the escape sequence starting at an ESC byte.
+ *
+ * Recognizes CSI (`ESC [ ... final`), OSC (`ESC ] ... BEL/ST`), DCS/SOS/PM/APC
+ * strings and two-byte/charset escapes; a lone or truncated ESC is consumed to
+ * the end of what is available.
+ */
+size_t ansi_sequence_length(const char* p, size_t n) {
+    if (n < 2) return n;
+    unsigned char kind = static_cast<unsigned char>(p[1]);
+    size_t i = 2;
+    if (kind == '[') {
+        while (i < n && static_cast<unsigned char>(p[i]) >= 0x20 && static_cast<unsigned char>(p[i]) <= 0x3F) ++i;
+        return i < n ? i + 1 : n;
+    }
+    if (kind == ']' || kind == 'P' || kind == 'X' || kind == '^' || kind == '_') {
+        // String sequences end with BEL (OSC only) or ST (ESC \)
+        for (; i < n; ++i) {
+            if (p[i] == '\a' && kind == ']') return i + 1;
+            if (p[i] == '\033' && i + 1 < n && p[i + 1] == '\\') return i + 2;
+        }
+        return n;
+    }
+    i = 1;
+    while (i < n && static_cast<unsigned char>(p[i]) >= 0x20 && static_cast<unsigned char>(p[i]) <= 0x2F) ++i;
+    return i < n ? i + 1 : n;
+}
+
+/**
+ * @brief Removes ANSI escape sequences from text in place.
+ *
+ * ESC bytes are located with memchr, which libc implements with SIMD, and the
+ * text between sequences is compacted with memmove, so input without escapes
+ * costs a single scan at memory bandwidth.
+ * @param text The text to clean; shrunk in place.
+ * @param spans If non-null, receives the SGR (color/style) sequences with their offsets in the stripped text.
+ * @return The number of sequences removed.
+ */
+size_t strip_ansi(std::string& text, std::vector<AnsiSpan>* spans) {
+    char* data = text.data();
+    const size_t n = text.size();
+    const void* first = std::memchr(data, '\033', n);
+    if (!first) return 0;
+    size_t write = static_cast<const char*>(first) - data;
+    size_t read = write;
+    size_t removed = 0;
+    while (read < n) {
+        size_t len = ansi_sequence_length(data + read, n - read);
+        if (spans && len >= 3 && data[read + 1] == '[' && data[read + len - 1] == 'm') {
+            spans->push_back({write, std::string(data + read, len)});
+        }
+        read += len;
+        ++removed;
+        const void* next = read < n ? std::memchr(data + read, '\033', n - read) : nullptr;
+        size_t chunk = (next ? static_cast<const char*>(next) - data : n) - read;
+        std::memmove(data + write, data + read, chunk);
+        write += chunk;
+        read += chunk;
+    }
+    text.resize(write);
+    return removed;
+}
+
+/**
+ * @brief Re-applies stripped SGR sequences to a span of the stripped text.
+ *
+ * Spans must be visited in increasing offset order; `next` and `active` carry
+ * the position in the side table and the style in effect between calls.
+ * @param text The cell/slice of the stripped text to render.
+ * @param offset Offset of `text` in the stripped text.
+ * @param spans The side table produced by strip_ansi().
+ * @param next In/out: index of the first span not yet consumed.
+ * @param active In/out: SGR sequences in effect since the last reset.
+ * @return The text with the original colors restored and reset at its end.
+ */
+std::string reapply_ansi(std::string_view text, size_t offset, const std::vector<AnsiSpan>& spans, size_t& next, std::string& active) {
+    auto consume = [&](const std::string& seq) {
+        if (seq == "\033[m" || seq == "\033[0m") active.clear();
+        else active += seq;
+    };
+    while (next < spans.size() && spans[next].offset <= offset) consume(spans[next++].sequence);
+    if (active.empty() && (next == spans.size() || spans[next].offset >= offset + text.size())) return std::string(text);
+    std::string out = active;
+    size_t pos = 0;
+    while (next < spans.size() && spans[next].offset < offset + text.size()) {
+        size_t at = spans[next].offset - offset;
+        out.append(text.substr(pos, at - pos));
+        out += spans[next].sequence;
+        consume(spans[next++].sequence);
+        pos = at;
+    }
+    out.append(text.substr(pos));
+    return out + "\033[0m";
+}
+
+// Table rows are views into the input buffer, held in arena-backed containers
+using TableRow = std::pmr::vector<std::string_view>;
+using Table = std::pmr::vector<TableRow>;
+
+/**
+ * @brief Splits table text into rows of whitespace-separated fields.
+ *
+ * Rows after the first have at most as many fields as the header: the last
+ * field runs to the end of the line, so a free-text column such as the
+ * COMMAND of `ps aux` stays one cell.
+ * @param input The raw table string.
+ * @param arena Memory resource for the row containers.
+ * @return Rows of fields, as views into `input`; blank lines are skipped.
+ */
+Table parse_table(std::string_view input, std::pmr::memory_resource* arena = std::pmr::get_default_resource()) {
+    Table rows(arena);
+    size_t start = 0;
+    while (start < input.size()) {
+        size_t end = input.find('\n', start);
+        if (end == std::string_view::npos) end = input.size();
+        TableRow fields(arena);
+        const size_t limit = rows.empty() ? std::string_view::npos : rows[0].size();
+        size_t i = start;
+        while (i < end) {
+            while (i < end && std::isspace(static_cast<unsigned char>(input[i]))) ++i;
+            size_t b = i;
+            while (i < end && !std::isspace(static_cast<unsigned char>(input[i]))) ++i;
+            if (i > b && fields.size() + 1 == limit) {
+                // Last column: take the rest of the line, trailing whitespace trimmed
+                i = end;
+                while (i > b && std::isspace(static_cast<unsigned char>(input[i - 1]))) --i;
+                fields.push_back(input.substr(b, i - b));
+                break;
+            }
+            if (i > b) fields.push_back(input.substr(b, i - b));
+        }
+        if (!fields.empty()) rows.push_back(std::move(fields));
+        start = end + 1;
+    }
+    return rows;
+}
+
+/**
+ * @brief Value types recognized in table columns, from the most to the least specific parse.
+ */
+enum class ColumnType { TEXT, INTEGER, FLOAT, PERCENT, BYTES, DURATION, TIMESTAMP };
+
+/**
+ * @brief One `--agg` term: count, or sum/avg/min/max of a column.
+ */
+struct Aggregate {
+    enum class Function { COUNT, SUM, AVG, MIN, MAX } function = Function::COUNT;
+    std::string column; // Header name or 1-based index; empty for count
+};
+
+/**
+ * @brief Parses an `--agg` list such as `count,sum(RSS),avg(%CPU)`.
+ * @param spec The comma-separated terms.
+ * @return The terms; throws std::runtime_error on syntax errors.
+ */
+std::vector<Aggregate> parse_aggregates(const std::string& spec) {
+    static constexpr std::array<std::pair<std::string_view, Aggregate::Function>, 4> functions = {{
+        {"sum", Aggregate::Function::SUM}, {"avg", Aggregate::Function::AVG},
+        {"min", Aggregate::Function::MIN}, {"max", Aggregate::Function::MAX},
+    }};
+    std::vector<Aggregate> aggregates;
+    size_t start = 0;
+    while (start <= spec.size()) {
+        // Commas inside parentheses belong to the column name
+        size_t end = start;
+        for (int depth = 0; end < spec.size() && (spec[end] != ',' || depth > 0); ++end) {
+            depth += spec[end] == '(' ? 1 : spec[end] == ')' ? -1 : 0;
+        }
+        std::string_view term(spec.data() + start, end - start);
+        if (term == "count") {
+            aggregates.push_back({});
+        } else {
+            auto fn = std::find_if(functions.begin(), functions.end(), [&](const auto& f) {
+                return term.size() > f.first.size() + 2 && term.substr(0, f.first.size()) == f.first &&
+                       term[f.first.size()] == '(' && term.back() == ')';
+            });
+            if (fn == functions.end()) {
+                throw std::runtime_error("Invalid --agg term '" + std::string(term) + "': expected count, sum(COL), avg(COL), min(COL) or max(COL)");
+            }
+            aggregates.push_back({fn->second, std::string(term.substr(fn->first.size() + 1, term.size() - fn->first.size() - 2))});
+        }
+        start = end + 1;
+    }
+    return aggregates;
+}
+
+/**
+ * @brief Per-table options (`--normalize-units`, `--group-by`, `--agg`, `--sort`, `--top`).
+ */
+struct TableOptions {
+    bool normalize_units = false; // Rewrite byte-size columns to one unit
+    std::string sort;             // --sort column (header name or 1-based index); empty for input order
+    bool descending = false;      // --sort=-COL
+    size_t top = 0;               // --top row limit; 0 for all rows
+    std::string group_by;         // --group-by column; empty for no grouping
+    std::vector<Aggregate> aggregates; // --agg terms (default: count)
+};
+
+/**
+ * @brief Days since 1970-01-01 for a proleptic Gregorian date (Hinnant's days_from_civil).
+ */
+constexpr int64_t days_from_civil(int64_t y, unsigned m, unsigned d) {
+    y -= m <= 2;
+    const int64_t era = (y >= 0 ? y : y - 399) / 400;
+    const unsigned yoe = static_cast<unsigned>(y - era * 400);
+    const unsigned doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+    const unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + static_cast<int64_t>(doe) - 719468;
+}
+
+/**
+ * @brief Formats seconds since the Unix epoch as "YYYY-MM-DDTHH:MM:SSZ" (Hinnant's civil_from_days).
+ */
+std::string format_timestamp(double seconds) {
+    int64_t total = static_cast<int64_t>(std::floor(seconds));
+    int64_t days = (total >= 0 ? total : total - 86399) / 86400;
+    int64_t rest = total - days * 86400;
+    days += 719468;
+    const int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+    const unsigned doe = static_cast<unsigned>(days - era * 146097);
+    const unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    const unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    const unsigned mp = (5 * doy + 2) / 153;
+    const unsigned day = doy - (153 * mp + 2) / 5 + 1;
+    const unsigned month = mp < 10 ? mp + 3 : mp - 9;
+    const int64_t year = static_cast<int64_t>(yoe) + era * 400 + (month <= 2);
+    const unsigned second = static_cast<unsigned>(rest); // In [0, 86400) by construction
+    // Sized for the widest int64 year, so far-off values are printed rather than cut
+    char buffer[64];
+    std::snprintf(buffer, sizeof(buffer), "%04lld-%02u-%02uT%02u:%02u:%02uZ", static_cast<long long>(year), month, day,
+                  second / 3600 % 24, second / 60 % 60, second % 60);
+    return buffer;
+}
+
+/**
+ * @brief Reads `count` ASCII digits at `p` as a number.
+ * @return The value, or -1 if any of them is not a digit.
+ */
+inline int fixed_digits(const char* p, size_t count) {
+    int value = 0;
+    unsigned bad = 0;
+    for (size_t i = 0; i < count; ++i) {
+        unsigned d = static_cast<unsigned char>(p[i]) - '0';
+        bad |= d > 9;
+        value = value * 10 + static_cast<int>(d);
+    }
+    return bad ? -1 : value;
+}
+
+/**
+ * @brief Parses an ISO-8601 date or date-time: "2024-05-01", "2024-05-01T10:22:03.5Z", "2024-05-01 10:22+02:00".
+ * @return Seconds since the Unix epoch (UTC), or NaN.
+ */
+double parse_iso_timestamp(std::string_view cell) {
+    const char* p = cell.data();
+    size_t n = cell.size();
+    if (n < 10 || p[4] != '-' || p[7] != '-') return std::nan("");
+    int year = fixed_digits(p, 4), month = fixed_digits(p + 5, 2), day = fixed_digits(p + 8, 2);
+    if (year < 0 || month < 1 || month > 12 || day < 1 || day > 31) return std::nan("");
+    double seconds = static_cast<double>(days_from_civil(year, static_cast<unsigned>(month), static_cast<unsigned>(day))) * 86400;
+    if (n == 10) return seconds;
+    if (n < 16 || (p[10] != 'T' && p[10] != 't' && p[10] != '_' && p[10] != ' ') || p[13] != ':') return std::nan("");
+    int hour = fixed_digits(p + 11, 2), minute = fixed_digits(p + 14, 2);
+    if (hour < 0 || hour > 23 || minute < 0 || minute > 59) return std::nan("");
+    seconds += hour * 3600 + minute * 60;
+    size_t i = 16;
+    if (i < n && p[i] == ':') {
+        if (n < 19) return std::nan("");
+        int second = fixed_digits(p + 17, 2);
+        if (second < 0 || second > 60) return std::nan("");
+        seconds += second;
+        i = 19;
+        if (i < n && (p[i] == '.' || p[i] == ',')) {
+            double scale = 0.1;
+            for (++i; i < n && p[i] >= '0' && p[i] <= '9'; ++i, scale /= 10) seconds += (p[i] - '0') * scale;
+        }
+    }
+    if (i == n) return seconds;
+    if ((p[i] == 'Z' || p[i] == 'z') && i + 1 == n) return seconds;
+    if ((p[i] == '+' || p[i] == '-') && (n - i == 6 || n - i == 5 || n - i == 3)) {
+        int zone_hour = fixed_digits(p + i + 1, 2);
+        int zone_minute = n - i == 3 ? 0 : fixed_digits(p + n - 2, 2);
+        if (zone_hour < 0 || zone_minute < 0 || (n - i == 6 && p[i + 3] != ':')) return std::nan("");
+        double offset = zone_hour * 3600 + zone_minute * 60;
+        return p[i] == '+' ? seconds - offset : seconds + offset;
+    }
+    return std::nan("");
+}
+
+/**
+ * @brief Classifies and parses one table cell without allocating.
+ *
+ * Recognized forms: integers and floats ("42", "-3.5", "1e6"), percentages
+ * ("85%"), byte sizes ("512", "12K", "3.4G", "512MiB", "1.5kB"; powers of 1024),
+ * durations ("45s", "250ms", "2d4h", "3h12m", "1:02:03", "2-03:04:05") and
+ * ISO-8601 timestamps. Size prefixes are upper case (K also lower case) and
+ * duration units lower case, so "12M" is 12 MiB and "12m" is 12 minutes.
+ * @param cell The cell text.
+ * @param value Out: the number; bytes for sizes, seconds for durations and
+ *              timestamps, and the number before the sign for percentages.
+ * @param clock Whether clock-style cells ("1:02:03") are durations; in a
+ *              column of start times they are a time of day and stay TEXT.
+ * @return The cell's type; TEXT (with `value` NaN) if it is none of the above.
+ */
+ColumnType parse_cell(std::string_view cell, double& value, bool clock = true) {
+    value = std::nan("");
+    if (cell.empty()) return ColumnType::TEXT;
+    const char* begin = cell.data();
+    const char* end = begin + cell.size();
+    const char* digits = begin + (*begin == '-');
+    if (digits == end || !(std::isdigit(static_cast<unsigned char>(*digits)) || *digits == '.')) return ColumnType::TEXT;
+
+    if (cell.size() >= 10 && cell[4] == '-' && cell[7] == '-') {
+        value = parse_iso_timestamp(cell);
+        return std::isnan(value) ? ColumnType::TEXT : ColumnType::TIMESTAMP;
+    }
+
+    double number = 0;
+    auto [ptr, ec] = std::from_chars(begin, end, number);
+    if (ec != std::errc() || ptr == begin) return ColumnType::TEXT;
+    std::string_view unit(ptr, end - ptr);
+    if (unit.empty()) {
+        value = number;
+        return std::string_view(begin, ptr - begin).find_first_of(".eE") == std::string_view::npos ? ColumnType::INTEGER : ColumnType::FLOAT;
+    }
+    if (unit == "%") {
+        value = number;
+        return ColumnType::PERCENT;
+    }
+
+    // Clock-style durations: [D-]H:MM[:SS] (ps TIME, uptime, elapsed)
+    if (unit[0] == ':' || (unit[0] == '-' && number >= 0)) {
+        if (!clock) return ColumnType::TEXT;
+        const bool with_days = unit[0] == '-';
+        const char* p = with_days ? ptr + 1 : begin;
+        double fields[3];
+        size_t count = 0;
+        while (true) {
+            auto [q, e] = std::from_chars(p, end, fields[count]);
+            if (e != std::errc() || q == p || fields[count] < 0 || ++count > 3) return ColumnType::TEXT;
+            if (q == end) break;
+            if (*q != ':' || count == 3) return ColumnType::TEXT;
+            p = q + 1;
+        }
+        if (count < 2) return ColumnType::TEXT;
+        double seconds = count == 3 ? fields[0] * 3600 + fields[1] * 60 + fields[2]
+                       : with_days ? fields[0] * 3600 + fields[1] * 60
+                                   : fields[0] * 60 + fields[1];
+        value = (with_days ? number * 86400 : 0) + seconds;
+        return ColumnType::DURATION;
+    }
+
+    // Byte sizes: K/M/G/T/P with optional i and B, or a bare B
+    static constexpr std::string_view prefixes = "KMGTP";
+    size_t power = prefixes.find(unit[0] == 'k' ? 'K' : unit[0]);
+    if (power != std::string_view::npos || unit == "B") {
+        if (power != std::string_view::npos) {
+            unit.remove_prefix(1);
+            if (!unit.empty() && unit[0] == 'i') unit.remove_prefix(1);
+        } else {
+            power = static_cast<size_t>(-1);
+        }
+        if (!unit.empty() && unit[0] == 'B') unit.remove_prefix(1);
+        if (!unit.empty()) return ColumnType::TEXT;
+        value = number * std::pow(1024.0, static_cast<double>(power + 1));
+        return ColumnType::BYTES;
+    }
+
+    // Unit durations, possibly compound ("2d4h", "3m12s", "250ms")
+    double seconds = 0;
+    const char* p = ptr;
+    while (true) {
+        double scale;
+        if (p + 1 < end && p[1] == 's' && (p[0] == 'm' || p[0] == 'u' || p[0] == 'n')) {
+            scale = p[0] == 'm' ? 1e-3 : p[0] == 'u' ? 1e-6 : 1e-9;
+            p += 2;
+        } else if (p + 2 < end && std::string_view(p, 3) == "µs") {
+            scale = 1e-6;
+            p += 3;
+        } else {
+            switch (*p) {
+                case 's': scale = 1; break;
+                case 'm': scale = 60; break;
+                case 'h': scale = 3600; break;
+                case 'd': scale = 86400; break;
+                case 'w': scale = 7 * 86400; break;
+                case 'y': scale = 365 * 86400; break;
+                default: return ColumnType::TEXT;
+            }
+            ++p;
+        }
+        seconds += number * scale;
+        if (p == end) break;
+        auto [q, e] = std::from_chars(p, end, number);
+        if (e != std::errc() || q == p || q == end || number < 0) return ColumnType::TEXT;
+        p = q;
+    }
+    value = seconds;
+    return ColumnType::DURATION;
+}
+
+/**
+ * @brief Whether a cell is a placeholder for a missing value ("-", "<none>", "n/a", "?").
+ */
+bool is_placeholder(std::string_view cell) {
+    return cell.empty() || cell == "-" || cell == "--" || cell == "?" || cell == "<none>" || cell == "<unknown>" ||
+           cell == "n/a" || cell == "N/A" || cell == "none";
+}
+
+/**
+ * @brief Whether a column type holds numbers (and is right-aligned and sortable by value).
+ */
+constexpr bool is_numeric(ColumnType type) {
+    return type != ColumnType::TEXT && type != ColumnType::TIMESTAMP;
+}
+
+/**
+ * @brief Whether a header names elapsed time (ps TIME/ELAPSED, kubectl AGE, top TIME+).
+ *
+ * Clock-style cells only count as durations in such columns; elsewhere
+ * ("START", "STIME") "09:00" is a time of day.
+ */
+bool is_duration_header(std::string_view name) {
+    std::string upper(name);
+    for (char& ch : upper) ch = static_cast<char>(std::toupper(static_cast<unsigned char>(ch)));
+    static constexpr std::string_view names[] = {"TIME", "TIME+", "CPU TIME", "ETIME", "ELAPSED", "AGE", "UPTIME", "DURATION"};
+    return std::find(std::begin(names), std::end(names), upper) != std::end(names) ||
+           upper.find("DURATION") != std::string::npos || upper.find("ELAPSED") != std::string::npos;
+}
+
+/**
+ * @brief Returns a cell's value if it fits its column's type.
+ *
+ * Plain numbers fit every numeric column (a bare "0" in a size or duration
+ * column, say); anything else must have the column's own type.
+ * @return The value, or NaN for text, placeholders and mismatched cells.
+ */
+double cell_value(std::string_view cell, ColumnType column) {
+    double value;
+    ColumnType type = parse_cell(cell, value);
+    if (type == column) return value;
+    if ((type == ColumnType::INTEGER || type == ColumnType::FLOAT) && is_numeric(column)) return value;
+    return std::nan("");
+}
+
+/**
+ * @brief Infers the type of each column from its body cells (row 0 is the header).
+ *
+ * A column takes a type when at least 80% of its non-placeholder cells parse
+ * as that type; plain numbers count toward percentage, size and duration
+ * columns, and integers toward float columns. Clock-style cells ("1:02:03")
+ * only count as durations under an is_duration_header() name.
+ * @param rows The table, header first.
+ * @param columns Number of columns to type.
+ * @param arena Memory resource for the result.
+ * @return One type per column; TEXT when no type dominates.
+ */
+std::pmr::vector<ColumnType> infer_column_types(const Table& rows, size_t columns, std::pmr::memory_resource* arena) {
+    std::pmr::vector<ColumnType> types(columns, ColumnType::TEXT, arena);
+    constexpr size_t kinds = static_cast<size_t>(ColumnType::TIMESTAMP) + 1;
+    for (size_t c = 0; c < columns; ++c) {
+        std::array<size_t, kinds> counts{};
+        size_t cells = 0;
+        double value;
+        const bool clock = !rows.empty() && c < rows[0].size() && is_duration_header(rows[0][c]);
+        for (size_t r = 1; r < rows.size(); ++r) {
+            if (c >= rows[r].size() || is_placeholder(rows[r][c])) continue;
+            ++cells;
+            ++counts[static_cast<size_t>(parse_cell(rows[r][c], value, clock))];
+        }
+        if (cells == 0) continue;
+        auto count = [&](ColumnType t) { return counts[static_cast<size_t>(t)]; };
+        size_t plain = count(ColumnType::INTEGER) + count(ColumnType::FLOAT);
+        ColumnType best = ColumnType::TEXT;
+        size_t score = 0;
+        for (ColumnType t : {ColumnType::PERCENT, ColumnType::BYTES, ColumnType::DURATION}) {
+            if (count(t) > 0 && count(t) + plain > score) {
+                best = t;
+                score = count(t) + plain;
+            }
+        }
+        if (best == ColumnType::TEXT && plain > 0) {
+            best = count(ColumnType::FLOAT) > 0 ? ColumnType::FLOAT : ColumnType::INTEGER;
+            score = plain;
+        }
+        if (count(ColumnType::TIMESTAMP) > score) {
+            best = ColumnType::TIMESTAMP;
+            score = count(ColumnType::TIMESTAMP);
+        }
+        if (score * 5 >= cells * 4) types[c] = best;
+    }
+    return types;
+}
+
+/**
+ * @brief Rewrites each byte-size column in a single unit ("1.2G", "0.5G", "0.0G").
+ *
+ * The unit is the one that fits the column's median, so typical values keep
+ * a leading digit. Rewritten cells are stored in `arena` and no longer point
+ * into the input.
+ * @param rows The table, header first; cells are replaced in place.
+ * @param types Column types from infer_column_types().
+ * @param arena Memory resource for the rewritten cell text.
+ */
+void normalize_units(Table& rows, const std::pmr::vector<ColumnType>& types, std::pmr::memory_resource* arena) {
+    static constexpr std::string_view suffixes = "BKMGTP";
+    std::pmr::vector<double> values(arena);
+    for (size_t c = 0; c < types.size(); ++c) {
+        if (types[c] != ColumnType::BYTES) continue;
+        values.clear();
+        for (size_t r = 1; r < rows.size(); ++r) {
+            double v = c < rows[r].size() ? cell_value(rows[r][c], ColumnType::BYTES) : std::nan("");
+            if (!std::isnan(v)) values.push_back(v);
+        }
+        if (values.empty()) continue;
+        std::nth_element(values.begin(), values.begin() + values.size() / 2, values.end());
+        double median = values[values.size() / 2];
+        int power = 0;
+        while (power + 1 < static_cast<int>(suffixes.size()) && std::fabs(median) >= std::pow(1024.0, power + 1)) ++power;
+        const double scale = std::pow(1024.0, power);
+        for (size_t r = 1; r < rows.size(); ++r) {
+            if (c >= rows[r].size()) continue;
+            double v = cell_value(rows[r][c], ColumnType::BYTES);
+            if (std::isnan(v)) continue;
+            char buffer[32];
+            auto result = std::to_chars(buffer, buffer + sizeof(buffer) - 1, v / scale, std::chars_format::fixed, power == 0 ? 0 : 1);
+            *result.ptr++ = suffixes[power];
+            size_t length = result.ptr - buffer;
+            char* text = static_cast<char*>(arena->allocate(length, 1));
+            std::memcpy(text, buffer, length);
+            rows[r][c] = std::string_view(text, length);
+        }
+    }
+}
+
+/**
+ * @brief Formats a value in the notation parse_cell() reads for its type ("3.4G", "12.5%", "2h30m").
+ */
+std::string format_value(double value, ColumnType type) {
+    char buffer[48];
+    auto fixed = [&](double v, int precision) {
+        auto result = std::to_chars(buffer, buffer + sizeof(buffer), v, std::chars_format::fixed, precision);
+        std::string text(buffer, result.ptr);
+        if (precision > 0 && text.find('.') != std::string::npos) {
+            text.erase(text.find_last_not_of('0') + 1);
+            if (text.back() == '.') text.pop_back();
+        }
+        return text;
+    };
+    switch (type) {
+        case ColumnType::INTEGER: return fixed(std::round(value), 0);
+        case ColumnType::PERCENT: return fixed(value, 1) + "%";
+        case ColumnType::BYTES: {
+            static constexpr std::string_view suffixes = "BKMGTP";
+            size_t power = 0;
+            while (power + 1 < suffixes.size() && std::fabs(value) >= std::pow(1024.0, static_cast<double>(power + 1))) ++power;
+            return fixed(value / std::pow(1024.0, static_cast<double>(power)), power == 0 ? 0 : 1) + suffixes[power];
+        }
+        case ColumnType::DURATION: {
+            if (std::fabs(value) < 1) return fixed(value * 1000, 1) + "ms";
+            static constexpr std::array<std::pair<double, char>, 4> units = {{{86400, 'd'}, {3600, 'h'}, {60, 'm'}, {1, 's'}}};
+            std::string text = value < 0 ? "-" : "";
+            double rest = std::round(std::fabs(value));
+            int parts = 0;
+            for (const auto& [seconds, unit] : units) {
+                if (rest < seconds && !(parts == 0 && unit == 's')) continue;
+                double whole = std::floor(rest / seconds);
+                rest -= whole * seconds;
+                text += fixed(whole, 0) + unit;
+                if (++parts == 2 || rest == 0) break;
+            }
+            return text;
+        }
+        case ColumnType::TIMESTAMP: return format_timestamp(value);
+        default: return fixed(value, 2);
+    }
+}
+
+/**
+ * @brief Flags outlier cells of numeric columns using the median and MAD.
+ *
+ * Only columns typed as numbers by infer_column_types() with at least five
+ * values are examined. Cells whose modified z-score 0.6745·|x − median| / MAD
+ * exceeds 3.5 are flagged (Iglewicz and Hoaglin); when more than half the
+ * values are equal (MAD = 0) the mean absolute deviation is used instead.
+ * Cells are parsed (from_chars, via parse_cell()) in a single pass over the
+ * rows into column-major arrays; the median is a per-column selection, the
+ * deviation and flagging loops run over contiguous doubles.
+ * @param rows The table, header first.
+ * @param types Column types from infer_column_types().
+ * @param arena Memory resource for the scratch arrays and result.
+ * @return Row-major flags: +1 for a high outlier, -1 for a low one, 0 otherwise.
+ */
+std::pmr::vector<int8_t> numeric_outliers(const Table& rows, const std::pmr::vector<ColumnType>& types, std::pmr::memory_resource* arena) {
+    const size_t columns = types.size();
+    std::pmr::vector<int8_t> flags(rows.size() * columns, 0, arena);
+    if (rows.size() < 6) return flags;
+    std::pmr::vector<size_t> numeric(arena);
+    for (size_t c = 0; c < columns; ++c) {
+        if (is_numeric(types[c])) numeric.push_back(c);
+    }
+    if (numeric.empty()) return flags;
+
+    // One pass over the rows parses every numeric cell into a column-major array; NaN marks misses
+    const size_t n = rows.size() - 1;
+    std::pmr::vector<double> values(numeric.size() * n, std::nan(""), arena);
+    for (size_t r = 1; r < rows.size(); ++r) {
+        for (size_t k = 0; k < numeric.size(); ++k) {
+            size_t c = numeric[k];
+            if (c < rows[r].size()) values[k * n + r - 1] = cell_value(rows[r][c], types[c]);
+        }
+    }
+
+    std::pmr::vector<double> scratch(arena);
+    auto median = [&]() {
+        size_t mid = scratch.size() / 2;
+        std::nth_element(scratch.begin(), scratch.begin() + mid, scratch.end());
+        double m = scratch[mid];
+        if (scratch.size() % 2 == 0) m = (m + *std::max_element(scratch.begin(), scratch.begin() + mid)) / 2;
+        return m;
+    };
+    for (size_t k = 0; k < numeric.size(); ++k) {
+        const double* column = values.data() + k * n;
+        scratch.clear();
+        for (size_t i = 0; i < n; ++i) {
+            if (!std::isnan(column[i])) scratch.push_back(column[i]);
+        }
+        if (scratch.size() < 5) continue;
+        const size_t count = scratch.size();
+        double med = median();
+        for (double& v : scratch) v = std::fabs(v - med);
+        double scale = median() / 0.6745;
+        if (scale == 0) {
+            double sum = 0;
+            for (double v : scratch) sum += v;
+            scale = 1.253314 * sum / count;
+        }
+        if (scale == 0) continue;
+        // Branch-free over the contiguous column; NaN cells compare false and stay unflagged
+        const double high = med + 3.5 * scale, low = med - 3.5 * scale;
+        int8_t* out = flags.data() + numeric[k];
+        for (size_t i = 0; i < n; ++i) {
+            out[(i + 1) * columns] = static_cast<int8_t>((column[i] > high) - (column[i] < low));
+        }
+    }
+    return flags;
+}
+
+/**
+ * @brief A parsed table with its column types, after the --normalize-units/--sort/--top operators.
+ */
+struct TableData {
+    Table rows;                          // Header first; cells view the input or arena-owned text
+    std::pmr::vector<ColumnType> types;  // One per header column
+    size_t skipped = 0;                  // Body rows dropped by --top
+    bool reordered = false;              // Rows are no longer in input order
+};
+
+/**
+ * @brief Finds a column by header name (case-insensitive) or 1-based index.
+ * @throws std::runtime_error if no column matches.
+ */
+size_t find_column(const TableRow& header, std::string_view name, std::string_view option) {
+    auto same = [](std::string_view a, std::string_view b) {
+        return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), [](char x, char y) {
+            return std::tolower(static_cast<unsigned char>(x)) == std::tolower(static_cast<unsigned char>(y));
+        });
+    };
+    for (size_t i = 0; i < header.size(); ++i) {
+        if (same(header[i], name)) return i;
+    }
+    size_t index = 0;
+    auto [ptr, ec] = std::from_chars(name.data(), name.data() + name.size(), index);
+    if (ec == std::errc() && ptr == name.data() + name.size() && index >= 1 && index <= header.size()) return index - 1;
+    std::string columns;
+    for (const auto& h : header) columns += (columns.empty() ? "" : ", ") + std::string(h);
+    throw std::runtime_error("Unknown column '" + std::string(name) + "' for " + std::string(option) + " (columns: " + columns + ")");
+}
+
+/**
+ * @brief Orders the body rows by one column and keeps the first `top` of them.
+ *
+ * Keys are extracted once into a contiguous array (numbers for typed
+ * columns, text otherwise); cells without a usable key sort last in either
+ * direction, and ties keep input order. Large tables are split into one
+ * chunk per worker: with a limit each chunk keeps only its best `top` keys
+ * (partial sort), without one each chunk is sorted; the chunks are then
+ * merged on the calling thread.
+ * @param table The table; body rows are reordered and truncated in place.
+ * @param column The key column.
+ * @param descending Largest first.
+ * @param top Rows to keep; 0 for all.
+ * @param arena Memory resource for the keys and the reordered rows.
+ */
+void sort_table(TableData& table, size_t column, bool descending, size_t top, std::pmr::memory_resource* arena) {
+    struct Key {
+        double number;
+        std::string_view text;
+        size_t row;
+    };
+    const size_t body = table.rows.size() - 1;
+    const ColumnType type = table.types[column];
+    const bool numeric = type != ColumnType::TEXT;
+    std::pmr::vector<Key> keys(body, arena);
+    auto less = [numeric, descending](const Key& a, const Key& b) {
+        if (numeric) {
+            bool a_missing = std::isnan(a.number), b_missing = std::isnan(b.number);
+            if (a_missing != b_missing) return b_missing;
+            if (!a_missing && a.number != b.number) return descending ? a.number > b.number : a.number < b.number;
+        } else {
+            bool a_missing = is_placeholder(a.text), b_missing = is_placeholder(b.text);
+            if (a_missing != b_missing) return b_missing;
+            if (!a_missing && a.text != b.text) return descending ? a.text > b.text : a.text < b.text;
+        }
+        return a.row < b.row;
+    };
+
+    Scheduler& scheduler = Scheduler::global();
+    const size_t chunks = body >= 64 * 1024 ? scheduler.jobs() : 1;
+    const size_t per_chunk = (body + chunks - 1) / chunks;
+    const size_t keep = top == 0 ? body : std::min(top, body);
+    std::pmr::vector<size_t> kept(chunks, 0, arena); // Sorted prefix length of each chunk
+    scheduler.parallel_for(chunks, [&](size_t c) {
+        size_t begin = c * per_chunk, end = std::min(body, begin + per_chunk);
+        if (begin >= end) return;
+        for (size_t i = begin; i < end; ++i) {
+            const auto& row = table.rows[i + 1];
+            std::string_view cell = column < row.size() ? row[column] : std::string_view();
+            keys[i] = {numeric ? cell_value(cell, type) : std::nan(""), cell, i + 1};
+        }
+        size_t best = std::min(keep, end - begin);
+        std::partial_sort(keys.begin() + begin, keys.begin() + begin + best, keys.begin() + end, less);
+        kept[c] = best;
+    });
+
+    // Merge the sorted chunk prefixes
+    std::pmr::vector<Key> merged(arena);
+    merged.reserve(std::min(body, keep + per_chunk));
+    for (size_t c = 0; c < chunks; ++c) {
+        if (kept[c] == 0) continue;
+        auto first = keys.begin() + c * per_chunk;
+        size_t middle = merged.size();
+        merged.insert(merged.end(), first, first + kept[c]);
+        std::inplace_merge(merged.begin(), merged.begin() + middle, merged.end(), less);
+        if (merged.size() > keep) merged.resize(keep);
+    }
+
+    Table rows(arena);
+    rows.reserve(merged.size() + 1);
+    rows.push_back(std::move(table.rows[0]));
+    for (const Key& key : merged) rows.push_back(std::move(table.rows[key.row]));
+    table.skipped += body - merged.size();
+    table.rows = std::move(rows);
+    table.reordered = true;
+}
+
+/**
+ * @brief Re-emits a prepared table as TSV for the prompt, dropping the padding used for alignment.
+ * @param table The table from prepare_table().
+ * @return One line per row with fields separated by tabs.
+ */
+std::string minify_table(const TableData& table) {
+    std::string out;
+    for (const auto& row : table.rows) {
+        for (size_t i = 0; i < row.size(); ++i) {
+            if (i > 0) out += '\t';
+            out += row[i];
+        }
+        out += '\n';
+    }
+    if (table.skipped > 0) out += "(" + std::to_string(table.skipped) + " more rows not shown)\n";
+    return out;
+}
+
+/**
+ * @brief Copies text into `arena`, returning a view of the copy.
+ */
+std::string_view arena_text(std::string_view text, std::pmr::memory_resource* arena) {
+    char* copy = static_cast<char*>(arena->allocate(text.size(), 1));
+    std::memcpy(copy, text.data(), text.size());
+    return {copy, text.size()};
+}
+
+/**
+ * @brief Groups the body rows by one column and computes aggregates per group (`--group-by`/`--agg`).
+ *
+ * A hash aggregation: large tables are split into one chunk per Scheduler
+ * worker, each chunk fills its own partial hash table (in its own arena),
+ * and the partials are merged on the calling thread. The result is a new
+ * table with the key column, then one column per term, most frequent group
+ * first; sums and averages keep the unit of their column.
+ * @param table The prepared table.
+ * @param key The column to group by.
+ * @param aggregates The terms; empty means count.
+ * @param arena Memory resource for the result and its cell text.
+ * @return The aggregated table.
+ * @throws std::runtime_error if a term names an unknown column.
+ */
+TableData aggregate_table(const TableData& table, size_t key, std::vector<Aggregate> aggregates, std::pmr::memory_resource* arena) {
+    if (aggregates.empty()) aggregates.push_back({});
+    const size_t terms = aggregates.size();
+    std::vector<size_t> columns(terms, 0);
+    for (size_t t = 0; t < terms; ++t) {
+        if (aggregates[t].function != Aggregate::Function::COUNT) columns[t] = find_column(table.rows[0], aggregates[t].column, "--agg");
+    }
+
+    struct Accumulator {
+        double sum = 0, min = INFINITY, max = -INFINITY;
+        size_t values = 0;
+    };
+    struct Group {
+        size_t rows = 0;
+        size_t first = 0; // First row of the group, for a stable order among equal counts
+        std::pmr::vector<Accumulator> terms;
+    };
+    using Groups = std::pmr::unordered_map<std::string_view, Group>;
+
+    const size_t body = table.rows.size() - 1;
+    Scheduler& scheduler = Scheduler::global();
+    const size_t chunks = body >= 64 * 1024 ? scheduler.jobs() : 1;
+    const size_t per_chunk = (body + chunks - 1) / chunks;
+    std::vector<std::unique_ptr<std::pmr::monotonic_buffer_resource>> arenas;
+    std::vector<Groups> partials;
+    arenas.reserve(chunks);
+    partials.reserve(chunks);
+    for (size_t c = 0; c < chunks; ++c) {
+        arenas.push_back(std::make_unique<std::pmr::monotonic_buffer_resource>(64 * 1024));
+        partials.emplace_back(arenas.back().get());
+    }
+    scheduler.parallel_for(chunks, [&](size_t c) {
+        Groups& groups = partials[c];
+        for (size_t r = c * per_chunk + 1; r <= std::min(body, (c + 1) * per_chunk); ++r) {
+            const auto& row = table.rows[r];
+            std::string_view name = key < row.size() ? row[key] : std::string_view("-");
+            auto [it, inserted] = groups.try_emplace(name);
+            Group& group = it->second;
+            if (inserted) {
+                group.first = r;
+                group.terms.resize(terms);
+            }
+            ++group.rows;
+            for (size_t t = 0; t < terms; ++t) {
+                if (aggregates[t].function == Aggregate::Function::COUNT || columns[t] >= row.size()) continue;
+                double v = cell_value(row[columns[t]], table.types[columns[t]]);
+                if (std::isnan(v)) continue;
+                Accumulator& acc = group.terms[t];
+                acc.sum += v;
+                acc.min = std::min(acc.min, v);
+                acc.max = std::max(acc.max, v);
+                ++acc.values;
+            }
+        }
+    });
+
+    // Merge the partial tables into the first
+    Groups& merged = partials[0];
+    for (size_t c = 1; c < chunks; ++c) {
+        for (auto& [name, part] : partials[c]) {
+            auto [it, inserted] = merged.try_emplace(name);
+            Group& group = it->second;
+            if (inserted) {
+                group.first = part.first;
+                group.terms.resize(terms);
+            }
+            group.rows += part.rows;
+            for (size_t t = 0; t < terms; ++t) {
+                group.terms[t].sum += part.terms[t].sum;
+                group.terms[t].min = std::min(group.terms[t].min, part.terms[t].min);
+                group.terms[t].max = std::max(group.terms[t].max, part.terms[t].max);
+                group.terms[t].values += part.terms[t].values;
+            }
+        }
+    }
+    std::vector<const std::pair<const std::string_view, Group>*> order;
+    order.reserve(merged.size());
+    for (const auto& entry : merged) order.push_back(&entry);
+    std::sort(order.begin(), order.end(), [](const auto* a, const auto* b) {
+        return a->second.rows != b->second.rows ? a->second.rows > b->second.rows : a->second.first < b->second.first;
+    });
+
+    // Build the result table; term columns keep the type of their source column
+    TableData result{Table(arena), std::pmr::vector<ColumnType>(arena)};
+    TableRow header(arena);
+    header.push_back(table.rows[0][key]);
+    result.types.push_back(table.types[key]);
+    static constexpr std::array<std::string_view, 5> names = {"count", "sum", "avg", "min", "max"};
+    for (size_t t = 0; t < terms; ++t) {
+        auto function = aggregates[t].function;
+        std::string_view name = names[static_cast<size_t>(function)];
+        header.push_back(function == Aggregate::Function::COUNT ? name
+                         : arena_text(std::string(name) + "(" + std::string(table.rows[0][columns[t]]) + ")", arena));
+        ColumnType type = function == Aggregate::Function::COUNT ? ColumnType::INTEGER : table.types[columns[t]];
+        if (function == Aggregate::Function::AVG && type == ColumnType::INTEGER) type = ColumnType::FLOAT;
+        if (type == ColumnType::TEXT) type = ColumnType::FLOAT;
+        result.types.push_back(type);
+    }
+    result.rows.push_back(std::move(header));
+    for (const auto* entry : order) {
+        const Group& group = entry->second;
+        TableRow row(arena);
+        row.push_back(entry->first);
+        for (size_t t = 0; t < terms; ++t) {
+            const Accumulator& acc = group.terms[t];
+            double value = std::nan("");
+            switch (aggregates[t].function) {
+                case Aggregate::Function::COUNT: value = static_cast<double>(group.rows); break;
+                case Aggregate::Function::SUM: value = acc.sum; break;
+                case Aggregate::Function::AVG: value = acc.values ? acc.sum / static_cast<double>(acc.values) : std::nan(""); break;
+                case Aggregate::Function::MIN: value = acc.values ? acc.min : std::nan(""); break;
+                case Aggregate::Function::MAX: value = acc.values ? acc.max : std::nan(""); break;
+            }
+            row.push_back(std::isnan(value) ? std::string_view("-") : arena_text(format_value(value, result.types[t + 1]), arena));
+        }
+        result.rows.push_back(std::move(row));
+    }
+    result.reordered = true;
+    return result;
+}
+
+/**
+ * @brief Picks the columns worth grouping by: text columns with a handful of distinct values.
+ * @param table The prepared table.
+ * @param limit Maximum number of columns to return.
+ * @return Column indexes, lowest cardinality first.
+ */
+std::vector<size_t> group_candidates(const TableData& table, size_t limit) {
+    const size_t body = table.rows.size() - 1;
+    const size_t max_distinct = std::min<size_t>(20, body / 10);
+    std::vector<std::pair<size_t, size_t>> candidates; // (distinct values, column)
+    for (size_t c = 0; c < table.types.size(); ++c) {
+        if (table.types[c] != ColumnType::TEXT) continue;
+        std::unordered_map<std::string_view, size_t> distinct;
+        for (size_t r = 1; r <= body && distinct.size() <= max_distinct; ++r) {
+            if (c < table.rows[r].size()) ++distinct[table.rows[r][c]];
+        }
+        if (distinct.size() >= 2 && distinct.size() <= max_distinct) candidates.emplace_back(distinct.size(), c);
+    }
+    std::stable_sort(candidates.begin(), candidates.end());
+    std::vector<size_t> columns;
+    for (size_t i = 0; i < candidates.size() && i < limit; ++i) columns.push_back(candidates[i].second);
+    return columns;
+}
+
+// Tables with more body rows than this are sent to the model as aggregates unless --group-by is given
+constexpr size_t AUTO_AGGREGATE_ROWS = 200;
+
+/**
+ * @brief Summarizes a large table for the prompt: a sample of rows plus per-group aggregates.
+ *
+ * Used instead of minify_table() when the table has more than
+ * AUTO_AGGREGATE_ROWS rows and no explicit --group-by: up to three
+ * low-cardinality columns are grouped, with counts and the sums of the
+ * percentage and size columns, so the model reasons over totals it could
+ * not compute reliably from thousands of rows.
+ * @param table The prepared table.
+ * @param arena Memory resource for the aggregated tables.
+ * @return The prompt data, or minify_table() output if no column qualifies.
+ */
+std::string summarize_table(const TableData& table, std::pmr::memory_resource* arena) {
+    std::vector<size_t> keys = group_candidates(table, 3);
+    if (keys.empty()) return minify_table(table);
+    std::vector<Aggregate> terms(1);
+    for (size_t c = 0; c < table.types.size() && terms.size() < 4; ++c) {
+        if (table.types[c] == ColumnType::PERCENT || table.types[c] == ColumnType::BYTES) {
+            terms.push_back({Aggregate::Function::SUM, std::to_string(c + 1)});
+        }
+    }
+    const size_t body = table.rows.size() - 1, shown = std::min<size_t>(body, 20);
+    TableData sample{Table(table.rows.begin(), table.rows.begin() + static_cast<std::ptrdiff_t>(shown + 1), arena), table.types, body - shown};
+    std::string out = std::to_string(body) + " rows. First " + std::to_string(shown) + ":\n" + minify_table(sample);
+    for (size_t key : keys) {
+        out += "\nAggregated by " + std::string(table.rows[0][key]) + ":\n" + minify_table(aggregate_table(table, key, terms, arena));
+    }
+    return out;
+}
+
+/**
+ * @brief Parses a table and applies the table operators: type columns, normalize units, group, sort, top.
+ *
+ * Both the local rendering and the prompt are built from the result, so the
+ * model sees exactly the rows the user does.
+ * @param input The raw table string.
+ * @param table_options The operators to apply.
+ * @param arena Memory resource for rows, types and rewritten cells.
+ * @return The prepared table; empty if the input has no rows.
+ * @throws std::runtime_error if --group-by, --agg or --sort names an unknown column.
+ */
+TableData prepare_table(std::string_view input, const TableOptions& table_options,
+                        std::pmr::memory_resource* arena = std::pmr::get_default_resource()) {
+    TableData table{parse_table(input, arena), std::pmr::vector<ColumnType>(arena)};
+    if (table.rows.empty()) return table;
+    table.types = infer_column_types(table.rows, table.rows[0].size(), arena);
+    if (table_options.normalize_units) normalize_units(table.rows, table.types, arena);
+    if (!table_options.group_by.empty()) {
+        size_t key = find_column(table.rows[0], table_options.group_by, "--group-by");
+        table = aggregate_table(table, key, table_options.aggregates, arena);
+    }
+    if (!table_options.sort.empty()) {
+        size_t column = find_column(table.rows[0], table_options.sort, "--sort");
+        sort_table(table, column, table_options.descending, table_options.top, arena);
+    } else if (table_options.top > 0 && table.rows.size() > table_options.top + 1) {
+        table.skipped = table.rows.size() - 1 - table_options.top;
+        table.rows.erase(table.rows.begin() + static_cast<std::ptrdiff_t>(table_options.top + 1), table.rows.end());
+    }
+    return table;
+}
+
+/**
+ * @brief Formats table input into a neatly aligned table, respecting terminal width.
+ * @param input The raw table string (with ANSI sequences already stripped).
+ * @param table The table prepared from `input` by prepare_table().
+ * @param terminal_width The width of the terminal in characters.
+ * @param colors Optional side table from strip_ansi(); the original cell colors are re-applied
+ *               while the rows are in input order.
+ * @param arena Memory resource for the parsed rows and column widths.
+ * @return A formatted table string with aligned columns; numeric columns are
+ *         right-aligned, and numeric outliers are colored (red high, cyan low)
+ *         with their rows set in bold.
+ */
+std::string format_table(const std::string& input, const TableData& table, int terminal_width,
+                         const std::vector<AnsiSpan>* colors = nullptr,
+                         std::pmr::memory_resource* arena = std::pmr::get_default_resource()) {
+    const Table& rows = table.rows;
+    const auto& types = table.types;
+    if (rows.empty()) return "";
+    if (table.reordered) colors = nullptr; // Re-applying needs the spans in input order
+
+    // Calculate maximum display width for each column; pure-ASCII input can use byte lengths
+    bool ascii = is_ascii(input);
+    auto cell_width = [ascii](std::string_view cell) { return ascii ? cell.size() : display_width(cell); };
+    std::pmr::vector<size_t> col_widths(rows[0].size(), 0, arena);
+    for (const auto& row : rows) {
+        for (size_t i = 0; i < row.size() && i < col_widths.size(); ++i) {
+            col_widths[i] = std::max(col_widths[i], cell_width(row[i]));
+        }
+    }
+
+    // Adjust column widths to fit within terminal width: cap the widest columns first,
+    // so one long free-text column does not truncate the narrow ones
+    size_t total_width = 0;
+    for (size_t w : col_widths) total_width += w + 2; // +2 for padding
+    if (total_width > static_cast<size_t>(terminal_width)) {
+        size_t padding = 2 * col_widths.size();
+        size_t budget = static_cast<size_t>(terminal_width) > padding ? terminal_width - padding : 0;
+        size_t low = 5, high = *std::max_element(col_widths.begin(), col_widths.end()); // Ensure minimum width of 5
+        while (low < high) {
+            size_t cap = (low + high + 1) / 2, used = 0;
+            for (size_t w : col_widths) used += std::min(w, cap);
+            if (used <= budget) low = cap;
+            else high = cap - 1;
+        }
+        for (size_t& w : col_widths) w = std::min(w, low);
+    }
+
+    // Flag numeric outliers so the key signal stands out before (or without) the model
+    const size_t columns = col_widths.size();
+    auto outliers = numeric_outliers(rows, types, arena);
+
+    // Build formatted table output, truncating on grapheme boundaries and padding by display width
+    std::string out;
+    size_t next_color = 0;
+    std::string active_color;
+    for (size_t r = 0; r < rows.size(); ++r) {
+        const auto& row = rows[r];
+        const int8_t* flags = outliers.data() + r * columns;
+        bool outlier_row = std::any_of(flags, flags + columns, [](int8_t f) { return f != 0; });
+        for (size_t j = 0; j < row.size() && j < columns; ++j) {
+            size_t width = cell_width(row[j]);
+            std::string_view cell = row[j];
+            if (width > col_widths[j]) cell = truncate_to_width(row[j], col_widths[j] - 1, width);
+            size_t fill = col_widths[j] - width - (cell.size() < row[j].size());
+            if (is_numeric(types[j])) out.append(fill, ' ');
+            if (outlier_row) out += flags[j] > 0 ? "\033[1;31m" : flags[j] < 0 ? "\033[1;36m" : "\033[1m";
+            // Cells rewritten by normalize_units() no longer have colors in the input
+            bool from_input = cell.data() >= input.data() && cell.data() < input.data() + input.size();
+            if (colors && !colors->empty() && from_input) {
+                out += reapply_ansi(cell, cell.data() - input.data(), *colors, next_color, active_color);
+            } else {
+                out += cell;
+            }
+            if (cell.size() < row[j].size()) out += "…";
+            if (outlier_row) out += "\033[0m";
+            out.append(is_numeric(types[j]) ? 2 : fill + 2, ' ');
+        }
+        out += '\n';
+    }
+    if (table.skipped > 0) out += "\033[2m… " + std::to_string(table.skipped) + " more rows\033[0m\n";
+    return out;
+}
+
+/**
+ * @brief Severity of a log line, from its level keyword.
+ */
+enum class Severity : uint8_t { INFO, WARN, ERROR };
+
+/**
+ * @brief Classifies a log line by the first level word in it ("ERROR", "warn", "CRIT", ...).
+ *
+ * Only whole words count, so "0 errors" or "errorHandler" stay informational.
+ */
+Severity line_severity(std::string_view line) {
+    static constexpr std::array<std::pair<std::string_view, Severity>, 12> levels = {{
+        {"ERROR", Severity::ERROR}, {"ERR", Severity::ERROR}, {"FATAL", Severity::ERROR}, {"CRIT", Severity::ERROR},
+        {"CRITICAL", Severity::ERROR}, {"PANIC", Severity::ERROR}, {"EMERG", Severity::ERROR}, {"ALERT", Severity::ERROR},
+        {"SEVERE", Severity::ERROR}, {"WARN", Severity::WARN}, {"WARNING", Severity::WARN}, {"WRN", Severity::WARN},
+    }};
+    char word[8];
+    for (size_t i = 0; i < line.size();) {
+        if (!std::isalpha(static_cast<unsigned char>(line[i]))) {
+            ++i;
+            continue;
+        }
+        size_t b = i;
+        while (i < line.size() && std::isalnum(static_cast<unsigned char>(line[i]))) ++i;
+        size_t n = i - b;
+        if (n < 3 || n > sizeof(word)) continue;
+        for (size_t k = 0; k < n; ++k) word[k] = static_cast<char>(std::toupper(static_cast<unsigned char>(line[b + k])));
+        for (const auto& [name, severity] : levels) {
+            if (name == std::string_view(word, n)) return severity;
+        }
+    }
+    return Severity::INFO;
+}
+
+/**
+ * @brief Parses a syslog/journald timestamp: "Oct  5 14:03:22" or "Oct 05 14:03:22.123456".
+ *
+ * The format has no year: the current year is assumed, or the previous one
+ * if that would put the line more than a day in the future. The time is
+ * taken as UTC, so lines stay comparable with each other.
+ * @return Seconds since the Unix epoch, or NaN.
+ */
+double parse_syslog_timestamp(std::string_view line) {
+    static constexpr std::string_view months = "JanFebMarAprMayJunJulAugSepOctNovDec";
+    const char* p = line.data();
+    if (line.size() < 15 || p[3] != ' ' || p[6] != ' ' || p[9] != ':' || p[12] != ':') return std::nan("");
+    size_t month = months.find(std::string_view(p, 3));
+    if (month == std::string_view::npos || month % 3 != 0) return std::nan("");
+    int day = p[4] == ' ' ? fixed_digits(p + 5, 1) : fixed_digits(p + 4, 2);
+    int hour = fixed_digits(p + 7, 2), minute = fixed_digits(p + 10, 2), second = fixed_digits(p + 13, 2);
+    if (day < 1 || day > 31 || hour < 0 || hour > 23 || minute < 0 || minute > 59 || second < 0 || second > 60) return std::nan("");
+    static const int64_t this_year = []() {
+        std::time_t now = std::time(nullptr);
+        std::tm utc{};
+        gmtime_r(&now, &utc);
+        return static_cast<int64_t>(utc.tm_year) + 1900;
+    }();
+    static const double now = static_cast<double>(std::time(nullptr));
+    auto at = [&](int64_t year) {
+        return static_cast<double>(days_from_civil(year, static_cast<unsigned>(month / 3 + 1), static_cast<unsigned>(day))) * 86400 +
+               hour * 3600 + minute * 60 + second;
+    };
+    double seconds = at(this_year);
+    if (seconds > now + 86400) seconds = at(this_year - 1);
+    if (line.size() > 16 && p[15] == '.') {
+        double scale = 0.1;
+        for (size_t i = 16; i < line.size() && p[i] >= '0' && p[i] <= '9'; ++i, scale /= 10) seconds += (p[i] - '0') * scale;
+    }
+    return seconds;
+}
+
+/**
+ * @brief Finds and parses the timestamp of a log line.
+ *
+ * Recognized at the start of the line (after an optional '['): ISO-8601 and
+ * RFC 3339 ("2024-05-01T10:22:03.123+02:00", "2024-05-01 10:22:03,123",
+ * journalctl -o short-iso), syslog and journalctl's default ("May  1 10:22:03"),
+ * and Unix epoch seconds or milliseconds ("1714558923.5"). An ISO timestamp
+ * elsewhere in the first 96 bytes is also found (logfmt `ts=...`, JSON logs).
+ * Every form is read at fixed offsets; no regex or strptime.
+ * @param line One line of input.
+ * @return Seconds since the Unix epoch, or NaN if the line has no timestamp.
+ */
+double parse_log_timestamp(std::string_view line) {
+    auto iso_at = [&](size_t at) {
+        // ISO runs over digits and -:.,+TZ, with one space allowed between date and time
+        size_t end = at;
+        while (end < line.size()) {
+            char c = line[end];
+            bool ok = (c >= '0' && c <= '9') || c == '-' || c == ':' || c == '.' || c == ',' || c == '+' ||
+                      c == 'T' || c == 'Z' || (c == ' ' && end == at + 10 && end + 1 < line.size() && line[end + 1] >= '0' && line[end + 1] <= '9');
+            if (!ok) break;
+            ++end;
+        }
+        while (end > at + 10 && (line[end - 1] == ':' || line[end - 1] == '.' || line[end - 1] == ',')) --end;
+        return parse_iso_timestamp(line.substr(at, end - at));
+    };
+
+    size_t start = line.size() > 0 && line[0] == '[' ? 1 : 0;
+    std::string_view head = line.substr(start);
+    if (head.size() >= 15 && std::isupper(static_cast<unsigned char>(head[0])) && head[3] == ' ') {
+        double value = parse_syslog_timestamp(head);
+        if (!std::isnan(value)) return value;
+    }
+    if (head.size() >= 10 && std::isdigit(static_cast<unsigned char>(head[0]))) {
+        size_t digits = 0;
+        while (digits < head.size() && std::isdigit(static_cast<unsigned char>(head[digits]))) ++digits;
+        if (digits == 10 || digits == 13) {
+            double value = 0;
+            std::from_chars(head.data(), head.data() + head.size(), value);
+            if (digits == 13) value /= 1000;
+            // 2001-09-09 .. 2100-01-01: plain counters and IDs fall outside
+            if (value >= 1e9 && value < 4102444800.0) return value;
+        }
+    }
+    size_t limit = std::min<size_t>(line.size(), 96);
+    for (size_t i = 0; i + 10 <= limit; ++i) {
+        if (line[i + 4] == '-' && line[i + 7] == '-' && std::isdigit(static_cast<unsigned char>(line[i])) &&
+            (i == 0 || !std::isdigit(static_cast<unsigned char>(line[i - 1])))) {
+            double value = iso_at(i);
+            if (!std::isnan(value)) return value;
+        }
+    }
+    return std::nan("");
+}
+
+/**
+ * @brief Log lines counted per time bucket and severity.
+ */
+struct LogTimeline {
+    double start = 0;                  // Start of the first bucket, seconds since the epoch
+    double width = 0;                  // Bucket width in seconds
+    std::vector<uint32_t> total, warnings, errors;
+    size_t lines = 0;                  // Non-empty lines in the input
+    size_t stamped = 0;                // Lines with a timestamp
+    size_t warning_lines = 0, error_lines = 0;
+};
+
+/**
+ * @brief Buckets the timestamped lines of a log by time and severity in one pass over the input.
+ *
+ * Each line's timestamp and severity are recorded in a compact array, then
+ * counted into buckets of a "round" width (1s, 5s, ... 1d, 7d) chosen so the
+ * whole span fits in `max_buckets`. Lines without a timestamp (stack traces,
+ * wrapped messages) are not counted as events.
+ * @param input The log text.
+ * @param max_buckets Maximum number of buckets (sparkline width).
+ * @param arena Memory resource for the per-line array.
+ * @return The timeline, or nothing if fewer than 10 lines (or a quarter of the
+ *         lines) carry a timestamp or they all share one instant.
+ */
+std::optional<LogTimeline> build_timeline(std::string_view input, size_t max_buckets, std::pmr::memory_resource* arena) {
+    struct Event {
+        double time;
+        Severity severity;
+    };
+    std::pmr::vector<Event> events(arena);
+    LogTimeline timeline;
+    double first = INFINITY, last = -INFINITY;
+    for (size_t pos = 0; pos < input.size();) {
+        size_t end = input.find('\n', pos);
+        if (end == std::string_view::npos) end = input.size();
+        std::string_view line = input.substr(pos, end - pos);
+        pos = end + 1;
+        if (line.find_first_not_of(" \t\r") == std::string_view::npos) continue;
+        ++timeline.lines;
+        double time = parse_log_timestamp(line);
+        if (std::isnan(time)) continue;
+        events.push_back({time, line_severity(line)});
+        first = std::min(first, time);
+        last = std::max(last, time);
+    }
+    timeline.stamped = events.size();
+    if (events.size() < 10 || events.size() * 4 < timeline.lines || last <= first) return std::nullopt;
+
+    static constexpr std::array<double, 18> widths = {1, 5, 10, 15, 30, 60, 120, 300, 600, 900, 1800, 3600,
+                                                      3 * 3600, 6 * 3600, 12 * 3600, 86400, 7 * 86400, 30 * 86400};
+    max_buckets = std::max<size_t>(max_buckets, 8);
+    timeline.width = widths.back();
+    for (double w : widths) {
+        if (std::floor(last / w) - std::floor(first / w) + 1 <= static_cast<double>(max_buckets)) {
+            timeline.width = w;
+            break;
+        }
+    }
+    timeline.start = std::floor(first / timeline.width) * timeline.width;
+    size_t buckets = static_cast<size_t>(std::floor(last / timeline.width) - std::floor(first / timeline.width)) + 1;
+    buckets = std::min(buckets, max_buckets);
+    timeline.total.assign(buckets, 0);
+    timeline.warnings.assign(buckets, 0);
+    timeline.errors.assign(buckets, 0);
+    for (const Event& e : events) {
+        size_t b = std::min(buckets - 1, static_cast<size_t>((e.time - timeline.start) / timeline.width));
+        ++timeline.total[b];
+        timeline.warnings[b] += e.severity == Severity::WARN;
+        timeline.errors[b] += e.severity == Severity::ERROR;
+        timeline.warning_lines += e.severity == Severity::WARN;
+        timeline.error_lines += e.severity == Severity::ERROR;
+    }
+    return timeline;
+}
+
+/**
+ * @brief Labels a bucket start: "10:35", "10:35:20" for sub-minute buckets, or with the date for multi-day spans.
+ */
+std::string timeline_label(const LogTimeline& timeline, double seconds) {
+    std::string iso = format_timestamp(seconds); // YYYY-MM-DDTHH:MM:SSZ
+    bool multi_day = timeline.width * static_cast<double>(timeline.total.size()) > 86400;
+    std::string clock = iso.substr(11, timeline.width < 60 ? 8 : 5);
+    if (timeline.width >= 86400) return iso.substr(0, 10);
+    return multi_day ? iso.substr(5, 5) + " " + clock : clock;
+}
+
+/**
+ * @brief Renders a timeline as sparklines (▁▂▃▄▅▆▇█, blank for empty buckets): all lines, warnings and errors.
+ */
+std::string format_timeline(const LogTimeline& timeline) {
+    static constexpr std::array<std::string_view, 8> blocks = {"▁", "▂", "▃", "▄", "▅", "▆", "▇", "█"};
+    const std::string width = format_value(timeline.width, ColumnType::DURATION);
+    double end = timeline.start + timeline.width * static_cast<double>(timeline.total.size());
+    auto minute = [](double seconds) {
+        std::string iso = format_timestamp(seconds).substr(0, 16);
+        iso[10] = ' ';
+        return iso;
+    };
+    std::string out = "\033[1mLog timeline\033[0m " + minute(timeline.start) + " → " + minute(end) + " (" + width + " buckets, " +
+                      std::to_string(timeline.stamped) + " timestamped lines)\n";
+    auto row = [&](const char* name, const std::vector<uint32_t>& counts, size_t sum, const char* color) {
+        if (sum == 0) return;
+        size_t peak = std::max_element(counts.begin(), counts.end()) - counts.begin();
+        uint32_t max = counts[peak];
+        out += "  " + std::string(name) + color;
+        for (uint32_t c : counts) out += c == 0 ? std::string_view(" ") : blocks[std::min<size_t>(7, (c * 8 - 1) / max)];
+        out += "\033[0m " + std::to_string(sum);
+        if (&counts != &timeline.total) {
+            char share[16];
+            std::snprintf(share, sizeof(share), " (%.1f%%)", 100.0 * sum / timeline.stamped);
+            out += share;
+        }
+        out += ", peak " + std::to_string(max) + "/" + width + " at " + timeline_label(timeline, timeline.start + timeline.width * peak) + "\n";
+    };
+    row("all    ", timeline.total, timeline.stamped, "");
+    row("warn   ", timeline.warnings, timeline.warning_lines, "\033[33m");
+    row("error  ", timeline.errors, timeline.error_lines, "\033[31m");
+    return out;
+}
+
+/**
+ * @brief Describes a timeline for the prompt: bucket layout, per-bucket counts and peaks.
+ */
+std::string timeline_prompt(const LogTimeline& timeline) {
+    auto counts = [](const std::vector<uint32_t>& v) {
+        std::string out;
+        for (size_t i = 0; i < v.size(); ++i) out += (i ? "," : "") + std::to_string(v[i]);
+        return out;
+    };
+    std::string out = "Log rate computed locally from " + std::to_string(timeline.stamped) + " timestamped lines, in " +
+                      format_value(timeline.width, ColumnType::DURATION) + " buckets starting " + format_timestamp(timeline.start) +
+                      " (use these numbers for rates and spikes instead of counting lines yourself):\n";
+    out += "lines: " + counts(timeline.total) + "\n";
+    if (timeline.warning_lines) out += "warnings: " + counts(timeline.warnings) + "\n";
+    if (timeline.error_lines) out += "errors: " + counts(timeline.errors) + "\n";
+    return out;
+}
+
+/**
+ * @brief Commands whose output eo can recognize.
+ */
+enum class Command {
+    UNKNOWN, DF, FREE, PS, DOCKER_PS, DOCKER_IMAGES, DOCKER_COMPOSE_PS, KUBECTL_PODS, KUBECTL_NODES,
+    KUBECTL_SERVICES, KUBECTL_DEPLOYMENTS, HELM_LIST, SYSTEMCTL_UNITS, JOURNALCTL, LS_LONG, LSBLK, SS,
+    NETSTAT, GIT_STATUS, GIT_LOG, GIT_DIFF
+};
+
+/**
+ * @brief A known command signature: the normalized first tokens of its output.
+ *
+ * Normalization lowercases tokens, collapses whitespace and replaces numbers
+ * and hex hashes with `#`, so "commit 3f2a9c1..." and "total 48" match
+ * "commit #" and "total #".
+ */
+struct CommandSignature {
+    std::string_view tokens;
+    Command command;
+    std::string_view name;
+};
+
+constexpr std::array<CommandSignature, 28> COMMAND_SIGNATURES = {{
+    {"filesystem size used avail", Command::DF, "df -h"},
+    {"filesystem 1k-blocks used available", Command::DF, "df"},
+    {"filesystem type size used", Command::DF, "df -hT"},
+    {"total used free shared", Command::FREE, "free"},
+    {"user pid %cpu %mem", Command::PS, "ps aux"},
+    {"uid pid ppid c", Command::PS, "ps -ef"},
+    {"pid tty time cmd", Command::PS, "ps"},
+    {"container id image command", Command::DOCKER_PS, "docker ps"},
+    {"repository tag image id", Command::DOCKER_IMAGES, "docker images"},
+    {"name image command service", Command::DOCKER_COMPOSE_PS, "docker compose ps"},
+    {"name ready status restarts", Command::KUBECTL_PODS, "kubectl get pods"},
+    {"namespace name ready status", Command::KUBECTL_PODS, "kubectl get pods -A"},
+    {"name status roles age", Command::KUBECTL_NODES, "kubectl get nodes"},
+    {"name type cluster-ip external-ip", Command::KUBECTL_SERVICES, "kubectl get services"},
+    {"name ready up-to-date available", Command::KUBECTL_DEPLOYMENTS, "kubectl get deployments"},
+    {"name namespace revision updated", Command::HELM_LIST, "helm list"},
+    {"unit load active sub", Command::SYSTEMCTL_UNITS, "systemctl list-units"},
+    {"-- logs begin", Command::JOURNALCTL, "journalctl"},
+    {"-- journal begins", Command::JOURNALCTL, "journalctl"},
+    {"total #", Command::LS_LONG, "ls -l"},
+    {"name maj:min rm size", Command::LSBLK, "lsblk"},
+    {"netid state recv-q send-q", Command::SS, "ss"},
+    {"state recv-q send-q local", Command::SS, "ss -t"},
+    {"proto recv-q send-q local", Command::NETSTAT, "netstat"},
+    {"on branch", Command::GIT_STATUS, "git status"},
+    {"head detached at", Command::GIT_STATUS, "git status"},
+    {"commit #", Command::GIT_LOG, "git log"},
+    {"diff --git", Command::GIT_DIFF, "git diff"},
+}};
+
+/**
+ * @brief Seeded FNV-1a hash, usable at compile time.
+ */
+constexpr uint32_t signature_hash(std::string_view s, uint32_t seed) {
+    uint32_t h = 2166136261u ^ seed;
+    for (char c : s) {
+        h ^= static_cast<unsigned char>(c);
+        h *= 16777619u;
+    }
+    return h ^ (h >> 15);
+}
+
+constexpr size_t SIGNATURE_SLOTS = 64; // Power of two, at least twice the number of signatures
+
+/**
+ * @brief Finds a seed for which every signature lands in its own slot (a perfect hash).
+ */
+constexpr uint32_t find_signature_seed() {
+    for (uint32_t seed = 1; seed < 1000000; ++seed) {
+        std::array<bool, SIGNATURE_SLOTS> used{};
+        bool collision = false;
+        for (const auto& sig : COMMAND_SIGNATURES) {
+            size_t slot = signature_hash(sig.tokens, seed) & (SIGNATURE_SLOTS - 1);
+            if (used[slot]) {
+                collision = true;
+                break;
+            }
+            used[slot] = true;
+        }
+        if (!collision) return seed;
+    }
+    return 0;
+}
+
+constexpr uint32_t SIGNATURE_SEED = find_signature_seed();
+static_assert(SIGNATURE_SEED != 0, "no perfect hash seed for COMMAND_SIGNATURES");
+
+/**
+ * @brief Slot table of the perfect hash: index into COMMAND_SIGNATURES plus one, 0 for empty.
+ */
+constexpr std::array<uint8_t, SIGNATURE_SLOTS> SIGNATURE_TABLE = [] {
+    std::array<uint8_t, SIGNATURE_SLOTS> table{};
+    for (size_t i = 0; i < COMMAND_SIGNATURES.size(); ++i) {
+        table[signature_hash(COMMAND_SIGNATURES[i].tokens, SIGNATURE_SEED) & (SIGNATURE_SLOTS - 1)] = static_cast<uint8_t>(i + 1);
+    }
+    return table;
+}();
+
+/**
+ * @brief Which command produced the input, as far as eo can tell.
+ */
+struct Fingerprint {
+    Command command = Command::UNKNOWN;
+    std::string_view name; // Display name such as "kubectl get pods"; empty if unknown
+};
+
+/**
+ * @brief Identifies the command that produced the input from its first lines.
+ *
+ * Up to three non-blank leading lines are normalized to at most four tokens;
+ * the 4-, 3- and 2-token prefixes of each are looked up in the perfect hash
+ * table, so the cost is constant regardless of input size.
+ * @param input The (ANSI-stripped) input.
+ * @return The fingerprint; UNKNOWN if nothing matched.
+ */
+Fingerprint fingerprint_command(std::string_view input) {
+    const size_t max_lines = 3, max_tokens = 4;
+    size_t pos = 0;
+    for (size_t line_no = 0; line_no < max_lines && pos < input.size();) {
+        size_t end = input.find('\n', pos);
+        if (end == std::string_view::npos) end = input.size();
+        std::string_view line = input.substr(pos, std::min<size_t>(end - pos, 256));
+        pos = end + 1;
+
+        // Normalize: lowercase tokens joined by single spaces, numbers and hashes as '#'
+        char buf[128];
+        size_t len = 0, tokens = 0;
+        std::array<size_t, max_tokens> prefix_end{};
+        for (size_t i = 0; i < line.size() && tokens < max_tokens;) {
+            while (i < line.size() && std::isspace(static_cast<unsigned char>(line[i]))) ++i;
+            size_t b = i;
+            while (i < line.size() && !std::isspace(static_cast<unsigned char>(line[i]))) ++i;
+            if (i == b) break;
+            std::string_view token = line.substr(b, i - b);
+            bool digits = token.find_first_not_of("0123456789") == std::string_view::npos;
+            bool hash = token.size() >= 7 && token.find_first_not_of("0123456789abcdef") == std::string_view::npos;
+            if (len + token.size() + 1 >= sizeof(buf)) break;
+            if (tokens > 0) buf[len++] = ' ';
+            if (digits || hash) {
+                buf[len++] = '#';
+            } else {
+                for (char c : token) buf[len++] = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+            }
+            prefix_end[tokens++] = len;
+        }
+        if (tokens == 0) continue;
+        ++line_no;
+        for (size_t n = tokens; n >= 2; --n) {
+            std::string_view key(buf, prefix_end[n - 1]);
+            uint8_t slot = SIGNATURE_TABLE[signature_hash(key, SIGNATURE_SEED) & (SIGNATURE_SLOTS - 1)];
+            if (slot && COMMAND_SIGNATURES[slot - 1].tokens == key) {
+                return {COMMAND_SIGNATURES[slot - 1].command, COMMAND_SIGNATURES[slot - 1].name};
+            }
+        }
+    }
+    return {};
+}
+
+/**
+ * @brief One result of a local analyzer.
+ */
+struct Finding {
+    enum Level { OK, WARN, CRIT } level;
+    std::string text;
+};
+
+/**
+ * @brief Output of a well-known command, split into a header and rows of cells.
+ */
+struct CommandTable {
+    TableRow header;
+    Table rows;
+
+    explicit CommandTable(std::pmr::memory_resource* arena) : header(arena), rows(arena) {}
+
+    /** @brief Index of a header column, or SIZE_MAX. */
+    size_t column(std::string_view name) const {
+        for (size_t i = 0; i < header.size(); ++i) {
+            if (header[i] == name) return i;
+        }
+        return SIZE_MAX;
+    }
+
+    /** @brief Cell of a row by column index; empty if the row is short. */
+    static std::string_view cell(const TableRow& row, size_t column) {
+        return column < row.size() ? row[column] : std::string_view();
+    }
+};
+
+/**
+ * @brief A deterministic analyzer for the output of one common command.
+ */
+struct LocalAnalyzer {
+    Command id;                                    // Fingerprint the analyzer applies to
+    const char* command;                           // Command the output comes from, for display
+    std::array<std::string_view, 4> signature;     // Header columns that must appear, in order
+    bool aligned;                                  // Cells are sliced at header column offsets (values contain spaces)
+    size_t max_columns;                            // Whitespace mode: the last column takes the rest of the line (0 = no limit)
+    std::vector<Finding> (*analyze)(const CommandTable& table);
+};
+
+/**
+ * @brief Parses the leading number of a cell ("95%", "3 (2m ago)", "12.5").
+ * @return The number, or NaN if the cell does not start with one.
+ */
+double leading_number(std::string_view cell) {
+    double value = 0;
+    auto [ptr, ec] = std::from_chars(cell.data(), cell.data() + cell.size(), value);
+    return ec == std::errc() && ptr != cell.data() ? value : std::nan("");
+}
+
+/**
+ * @brief Parses a size with an optional unit suffix ("15Gi", "512M", "1.2T", "1024").
+ * @return The size in bytes (plain numbers are returned as-is), or NaN.
+ */
+double parse_size(std::string_view cell) {
+    double value = 0;
+    auto [ptr, ec] = std::from_chars(cell.data(), cell.data() + cell.size(), value);
+    if (ec != std::errc() || ptr == cell.data()) return std::nan("");
+    if (ptr == cell.data() + cell.size()) return value;
+    switch (std::toupper(static_cast<unsigned char>(*ptr))) {
+        case 'K': return value * 1024.0;
+        case 'M': return value * 1024.0 * 1024;
+        case 'G': return value * 1024.0 * 1024 * 1024;
+        case 'T': return value * 1024.0 * 1024 * 1024 * 1024;
+        case 'P': return value * 1024.0 * 1024 * 1024 * 1024 * 1024;
+        default: return value;
+    }
+}
+
+/**
+ * @brief Splits one line into cells, by whitespace or at fixed column offsets.
+ */
+TableRow split_command_line(std::string_view line, bool aligned, const std::vector<size_t>& offsets, size_t max_columns,
+                            std::pmr::memory_resource* arena) {
+    TableRow cells(arena);
+    auto trim = [](std::string_view v) {
+        size_t b = v.find_first_not_of(" \t"), e = v.find_last_not_of(" \t\r");
+        return b == std::string_view::npos ? std::string_view() : v.substr(b, e + 1 - b);
+    };
+    if (aligned) {
+        for (size_t j = 0; j < offsets.size() && offsets[j] < line.size(); ++j) {
+            size_t end = j + 1 < offsets.size() ? std::min(offsets[j + 1], line.size()) : line.size();
+            cells.push_back(trim(line.substr(offsets[j], end - offsets[j])));
+        }
+        return cells;
+    }
+    size_t i = 0;
+    while (i < line.size()) {
+        while (i < line.size() && std::isspace(static_cast<unsigned char>(line[i]))) ++i;
+        if (i >= line.size()) break;
+        if (max_columns && cells.size() + 1 == max_columns) {
+            cells.push_back(trim(line.substr(i)));
+            break;
+        }
+        size_t b = i;
+        while (i < line.size() && !std::isspace(static_cast<unsigned char>(line[i]))) ++i;
+        cells.push_back(line.substr(b, i - b));
+    }
+    return cells;
+}
+
+/**
+ * @brief Splits command output into header and rows the way an analyzer expects.
+ *
+ * Aligned output (kubectl, docker) names its columns with words separated by
+ * single spaces ("CONTAINER ID") and separates columns by two or more, so a
+ * column starts after a run of 2+ spaces. Rows end at the first blank line,
+ * which drops footers such as systemctl's legend.
+ */
+CommandTable split_command_output(std::string_view input, const LocalAnalyzer& analyzer, std::pmr::memory_resource* arena) {
+    CommandTable table(arena);
+    size_t pos = 0;
+    auto next_line = [&]() {
+        size_t end = input.find('\n', pos);
+        if (end == std::string_view::npos) end = input.size();
+        std::string_view line = input.substr(pos, end - pos);
+        pos = end + 1;
+        return line;
+    };
+    std::string_view header;
+    while (pos < input.size() && header.find_first_not_of(" \t\r") == std::string_view::npos) header = next_line();
+
+    std::vector<size_t> offsets;
+    if (analyzer.aligned) {
+        for (size_t i = 0; i < header.size(); ++i) {
+            bool starts = header[i] != ' ' && (i == 0 || (i >= 2 && header[i - 1] == ' ' && header[i - 2] == ' '));
+            if (starts) offsets.push_back(i);
+        }
+        for (size_t j = 0; j < offsets.size(); ++j) {
+            size_t end = j + 1 < offsets.size() ? offsets[j + 1] : header.size();
+            std::string_view name = header.substr(offsets[j], end - offsets[j]);
+            table.header.push_back(name.substr(0, name.find_last_not_of(" \r") + 1));
+        }
+        // Rows may begin slightly left of the header (leading bullet); snap the first column to 0
+        if (!offsets.empty()) offsets[0] = 0;
+    } else {
+        table.header = split_command_line(header, false, offsets, 0, arena);
+    }
+    while (pos < input.size()) {
+        std::string_view line = next_line();
+        if (line.find_first_not_of(" \t\r") == std::string_view::npos) break;
+        // systemctl marks failed units with a bullet that the header does not name
+        if (!analyzer.aligned && (line.rfind("● ", 0) == 0 || line.rfind("* ", 0) == 0)) line.remove_prefix(line.find(' ') + 1);
+        TableRow row = split_command_line(line, analyzer.aligned, offsets, analyzer.max_columns, arena);
+        if (!row.empty()) table.rows.push_back(std::move(row));
+    }
+    return table;
+}
+
+std::vector<Finding> analyze_df(const CommandTable& table) {
+    std::vector<Finding> findings;
+    size_t fs = table.column("Filesystem"), use = table.column("Use%"), avail = table.column("Avail");
+    if (avail == SIZE_MAX) avail = table.column("Available");
+    size_t mounted = table.column("Mounted"), checked = 0;
+    for (const auto& row : table.rows) {
+        std::string_view name = CommandTable::cell(row, fs), mount = CommandTable::cell(row, mounted);
+        // Read-only images (snaps, squashfs) are always full by design
+        if (name.rfind("/dev/loop", 0) == 0 || mount.rfind("/snap/", 0) == 0) continue;
+        double percent = leading_number(CommandTable::cell(row, use));
+        if (std::isnan(percent)) continue;
+        ++checked;
+        std::string where = std::string(mount.empty() ? name : mount) + " (" + std::string(name) + ")";
+        std::string left = avail != SIZE_MAX ? ", " + std::string(CommandTable::cell(row, avail)) + " free" : "";
+        if (percent >= 90) findings.push_back({Finding::CRIT, where + " is " + std::to_string(static_cast<int>(percent)) + "% full" + left});
+        else if (percent >= 80) findings.push_back({Finding::WARN, where + " is " + std::to_string(static_cast<int>(percent)) + "% full" + left});
+    }
+    if (findings.empty()) findings.push_back({Finding::OK, "All " + std::to_string(checked) + " filesystems are below 80% usage"});
+    return findings;
+}
+
+std::vector<Finding> analyze_free(const CommandTable& table) {
+    std::vector<Finding> findings;
+    // Data rows carry a label ("Mem:") the header does not name, so cells are shifted by one
+    size_t total = table.column("total"), used = table.column("used"), available = table.column("available");
+    for (const auto& row : table.rows) {
+        if (row.empty()) continue;
+        double t = parse_size(CommandTable::cell(row, total + 1));
+        if (std::isnan(t) || t <= 0) continue;
+        if (row[0] == "Mem:" && available != SIZE_MAX) {
+            double a = parse_size(CommandTable::cell(row, available + 1));
+            int percent = static_cast<int>(100 * a / t);
+            if (percent < 10) findings.push_back({Finding::CRIT, "Only " + std::to_string(percent) + "% of memory is available"});
+            else if (percent < 20) findings.push_back({Finding::WARN, "Only " + std::to_string(percent) + "% of memory is available"});
+            else findings.push_back({Finding::OK, std::to_string(percent) + "% of memory is available"});
+        } else if (row[0] == "Swap:") {
+            double u = parse_size(CommandTable::cell(row, used + 1));
+            int percent = static_cast<int>(100 * u / t);
+            if (percent >= 50) findings.push_back({Finding::WARN, "Swap is " + std::to_string(percent) + "% used"});
+        }
+    }
+    return findings;
+}
+
+std::vector<Finding> analyze_ps(const CommandTable& table) {
+    std::vector<Finding> findings;
+    size_t cpu = table.column("%CPU"), mem = table.column("%MEM"), stat = table.column("STAT"),
+           pid = table.column("PID"), command = table.column("COMMAND");
+    size_t zombies = 0, blocked = 0;
+    double top_cpu = -1;
+    std::string top;
+    for (const auto& row : table.rows) {
+        std::string_view state = CommandTable::cell(row, stat);
+        std::string who = std::string(CommandTable::cell(row, command)).substr(0, 60) + " (PID " + std::string(CommandTable::cell(row, pid)) + ")";
+        double c = leading_number(CommandTable::cell(row, cpu)), m = leading_number(CommandTable::cell(row, mem));
+        if (state.find('Z') != std::string_view::npos) ++zombies;
+        if (state.find('D') != std::string_view::npos) ++blocked;
+        if (c >= 80) findings.push_back({Finding::WARN, who + " is using " + std::string(CommandTable::cell(row, cpu)) + "% CPU"});
+        if (m >= 20) findings.push_back({Finding::WARN, who + " is using " + std::string(CommandTable::cell(row, mem)) + "% of memory"});
+        if (c > top_cpu) {
+            top_cpu = c;
+            top = who;
+        }
+    }
+    if (zombies) findings.push_back({Finding::CRIT, std::to_string(zombies) + " zombie process(es) waiting to be reaped"});
+    if (blocked) findings.push_back({Finding::WARN, std::to_string(blocked) + " process(es) in uninterruptible I/O wait"});
+    if (findings.empty()) {
+        findings.push_back({Finding::OK, std::to_string(table.rows.size()) + " processes, none above 80% CPU or 20% memory"});
+        if (!top.empty()) findings.push_back({Finding::OK, "Busiest: " + top + " at " + std::to_string(static_cast<int>(top_cpu)) + "% CPU"});
+    }
+    return findings;
+}
+
+std::vector<Finding> analyze_docker_ps(const CommandTable& table) {
+    std::vector<Finding> findings;
+    size_t status = table.column("STATUS"), names = table.column("NAMES");
+    size_t running = 0;
+    for (const auto& row : table.rows) {
+        std::string_view s = CommandTable::cell(row, status);
+        std::string name(CommandTable::cell(row, names));
+        if (s.rfind("Up", 0) == 0) ++running;
+        if (s.find("unhealthy") != std::string_view::npos) findings.push_back({Finding::CRIT, name + " is unhealthy: " + std::string(s)});
+        else if (s.rfind("Restarting", 0) == 0) findings.push_back({Finding::CRIT, name + " is restarting: " + std::string(s)});
+        else if (s.rfind("Exited", 0) == 0 && s.rfind("Exited (0)", 0) != 0) findings.push_back({Finding::WARN, name + " exited with an error: " + std::string(s)});
+        else if (s.rfind("Dead", 0) == 0 || s.rfind("Created", 0) == 0) findings.push_back({Finding::WARN, name + " is not running: " + std::string(s)});
+    }
+    if (findings.empty()) findings.push_back({Finding::OK, std::to_string(running) + " of " + std::to_string(table.rows.size()) + " containers up, none unhealthy or restarting"});
+    return findings;
+}
+
+std::vector<Finding> analyze_kubectl_pods(const CommandTable& table) {
+    std::vector<Finding> findings;
+    size_t name_col = table.column("NAME"), ready_col = table.column("READY"), status_col = table.column("STATUS"),
+           restarts_col = table.column("RESTARTS"), ns_col = table.column("NAMESPACE");
+    for (const auto& row : table.rows) {
+        std::string name(CommandTable::cell(row, name_col));
+        if (ns_col != SIZE_MAX) name = std::string(CommandTable::cell(row, ns_col)) + "/" + name;
+        std::string_view status = CommandTable::cell(row, status_col), ready = CommandTable::cell(row, ready_col);
+        double restarts = leading_number(CommandTable::cell(row, restarts_col));
+        if (status != "Running" && status != "Completed" && status != "Succeeded") {
+            findings.push_back({Finding::CRIT, name + " is " + std::string(status)});
+        } else if (status == "Running") {
+            size_t slash = ready.find('/');
+            if (slash != std::string_view::npos && ready.substr(0, slash) != ready.substr(slash + 1)) {
+                findings.push_back({Finding::WARN, name + " has only " + std::string(ready) + " containers ready"});
+            }
+        }
+        if (!std::isnan(restarts) && restarts > 0) {
+            findings.push_back({Finding::WARN, name + " restarted " + std::string(CommandTable::cell(row, restarts_col))});
+        }
     }
+    if (findings.empty()) findings.push_back({Finding::OK, "All " + std::to_string(table.rows.size()) + " pods are running and ready with no restarts"});
+    return findings;
+}
 
-    return Format::PLAIN_TEXT;
+std::vector<Finding> analyze_systemctl_units(const CommandTable& table) {
+    std::vector<Finding> findings;
+    size_t unit = table.column("UNIT"), active = table.column("ACTIVE"), sub = table.column("SUB"),
+           description = table.column("DESCRIPTION");
+    size_t units = 0;
+    for (const auto& row : table.rows) {
+        // Unit names always carry a type suffix; this skips the "N loaded units listed." footer
+        if (CommandTable::cell(row, unit).find('.') == std::string_view::npos) continue;
+        ++units;
+        // Plain `systemctl` lists healthy units too; only failed ones are reported
+        if (CommandTable::cell(row, active) != "failed" && CommandTable::cell(row, sub) != "failed") continue;
+        findings.push_back({Finding::CRIT, std::string(CommandTable::cell(row, unit)) + " " + std::string(CommandTable::cell(row, sub)) +
+                                               " — " + std::string(CommandTable::cell(row, description))});
+    }
+    if (findings.empty()) findings.push_back({Finding::OK, "No failed units among " + std::to_string(units) + " listed"});
+    return findings;
 }
 
 /**
- * @brief Formats JSON input with proper indentation, respecting terminal width.
- * @param input The raw JSON string.
- * @param terminal_width The width of the terminal in characters.
- * @return A formatted JSON string or an error message if invalid.
+ * @brief Registry of local analyzers, most specific signatures first.
  */
-std::string format_json(const std::string& input, int terminal_width) {
-    try {
-        auto j = nlohmann::json::parse(input);
-        // Adjust indentation based on terminal width (e.g., use 2 spaces if terminal is narrow)
-        int indent = terminal_width < 100 ? 2 : 4;
-        return j.dump(indent);
-    } catch (const nlohmann::json::exception& e) {
-        return "Error: Invalid JSON ─ " + std::string(e.what());
-    }
+const std::vector<LocalAnalyzer>& local_analyzers() {
+    static const std::vector<LocalAnalyzer> analyzers = {
+        {Command::DF, "df", {"Filesystem", "Used", "Use%", "Mounted"}, false, 6, analyze_df},
+        {Command::FREE, "free", {"total", "used", "free", "shared"}, false, 0, analyze_free},
+        {Command::PS, "ps aux", {"USER", "PID", "%CPU", "%MEM"}, false, 11, analyze_ps},
+        {Command::DOCKER_PS, "docker ps", {"CONTAINER ID", "IMAGE", "STATUS", "NAMES"}, true, 0, analyze_docker_ps},
+        {Command::KUBECTL_PODS, "kubectl get pods", {"NAME", "READY", "STATUS", "RESTARTS"}, true, 0, analyze_kubectl_pods},
+        {Command::SYSTEMCTL_UNITS, "systemctl units", {"UNIT", "LOAD", "ACTIVE", "SUB"}, false, 5, analyze_systemctl_units},
+    };
+    return analyzers;
 }
 
 /**
- * @brief Formats table input into a neatly aligned table, respecting terminal width.
- * @param input The raw table string.
- * @param terminal_width The width of the terminal in characters.
- * @return A formatted table string with aligned columns.
+ * @brief Finds the analyzer whose header signature matches the first line of the input.
+ * @param input The (ANSI-stripped) input.
+ * @param source The fingerprint of the input; when known, only analyzers for that command are tried.
+ * @param arena Memory resource for the header split.
+ * @return The analyzer, or nullptr.
  */
-std::string format_table(const std::string& input, int terminal_width) {
-    std::istringstream iss(input);
-    std::string line;
-    std::vector<std::vector<std::string>> rows;
-    
-    // Parse input into rows and fields
-    while (std::getline(iss, line)) {
-        std::regex space_regex("\\s+");
-        line = std::regex_replace(line, space_regex, " ");
-        std::istringstream line_stream(line);
-        std::vector<std::string> fields;
-        std::string field;
-        while (std::getline(line_stream, field, ' ')) {
-            if (!field.empty()) fields.push_back(field);
-        }
-        if (!fields.empty()) rows.push_back(fields);
-    }
-    if (rows.empty()) return "";
-
-    // Calculate maximum width for each column, ensuring total width fits terminal
-    std::vector<size_t> col_widths(rows[0].size(), 0);
-    for (const auto& row : rows) {
-        for (size_t i = 0; i < row.size(); ++i) {
-            col_widths[i] = std::max(col_widths[i], row[i].size());
-        }
-    }
-
-    // Adjust column widths to fit within terminal width
-    size_t total_width = 0;
-    for (size_t w : col_widths) total_width += w + 2; // +2 for padding
-    if (total_width > static_cast<size_t>(terminal_width)) {
-        size_t excess = total_width - terminal_width + col_widths.size(); // Account for padding
-        size_t reduce_per_col = excess / col_widths.size() + 1;
-        for (size_t& w : col_widths) {
-            w = std::max<size_t>(w - reduce_per_col, 5); // Ensure minimum width of 5
+const LocalAnalyzer* match_analyzer(std::string_view input, const Fingerprint& source,
+                                    std::pmr::memory_resource* arena = std::pmr::get_default_resource()) {
+    size_t end = input.find('\n');
+    std::string_view first = input.substr(0, std::min(end, input.size()));
+    for (const auto& analyzer : local_analyzers()) {
+        if (source.command != Command::UNKNOWN && analyzer.id != source.command) continue;
+        CommandTable table = split_command_output(first, analyzer, arena);
+        size_t k = 0;
+        for (std::string_view column : table.header) {
+            if (k < analyzer.signature.size() && column == analyzer.signature[k]) ++k;
         }
+        if (k == analyzer.signature.size()) return &analyzer;
     }
+    return nullptr;
+}
 
-    // Build formatted table output
-    std::stringstream ss;
-    for (size_t i = 0; i < rows.size(); ++i) {
-        for (size_t j = 0; j < rows[i].size(); ++j) {
-            std::string cell = rows[i][j].substr(0, col_widths[j]); // Truncate if too long
-            ss << std::left << std::setw(col_widths[j] + 2) << cell;
+/**
+ * @brief Renders analyzer findings with status icons, colored unless color is false.
+ */
+std::string format_findings(const LocalAnalyzer& analyzer, const std::vector<Finding>& findings, bool color = true) {
+    auto paint = [&](const char* code, const std::string& text) { return color ? code + text + "\033[0m" : text; };
+    std::string out = paint("\033[1m", std::string(analyzer.command) + " check") + "\n";
+    for (const auto& f : findings) {
+        switch (f.level) {
+            case Finding::CRIT: out += "  " + paint("\033[31m", "✖ " + f.text) + "\n"; break;
+            case Finding::WARN: out += "  " + paint("\033[33m", "⚠ " + f.text) + "\n"; break;
+            case Finding::OK: out += "  " + paint("\033[32m", "✔") + " " + f.text + "\n"; break;
         }
-        ss << '\n';
     }
-    return ss.str();
+    out.pop_back();
+    return out;
 }
 
 /**
@@ -208,9 +5123,10 @@ std::string get_url(int argc, char* argv[]) {
  * @brief Checks if the Ollama service is running and retrieves available models.
  * @param url The Ollama service URL.
  * @param models JSON object to store the retrieved models.
+ * @param error Receives the message to show if the check fails; reported only if the model is needed.
  * @return True if the service is running and models are retrieved, false otherwise.
  */
-bool check_service(const std::string& url, nlohmann::json& models) {
+bool check_service(const std::string& url, nlohmann::json& models, std::string& error) {
     httplib::Client cli(url);
     auto res = cli.Get("/api/tags");
     if (res && res->status == 200) {
@@ -218,11 +5134,11 @@ bool check_service(const std::string& url, nlohmann::json& models) {
             models = nlohmann::json::parse(res->body);
             return true;
         } catch (const nlohmann::json::exception& e) {
-            std::cerr << "\033[31mError parsing models data: " << e.what() << "\033[0m" << std::endl;
+            error = std::string("Error parsing models data: ") + e.what();
             return false;
         }
     } else {
-        std::cerr << "\033[31mOllama service not started or invalid url\033[0m" << std::endl;
+        error = "Ollama service not started or invalid url";
         return false;
     }
 }
@@ -256,167 +5172,963 @@ std::string unescape_string(const std::string& input) {
     return output;
 }
 
+/**
+ * @brief Removes `<think>...</think>` reasoning spans from streamed text as it arrives.
+ *
+ * Tags may be split across chunks, so a trailing fragment that could still
+ * become a tag is held back until the next chunk. Content inside a span is
+ * never inspected beyond looking for the closing tag, so stray `<` characters
+ * in the reasoning do not break the filter.
+ */
+class ThinkFilter {
+public:
+    explicit ThinkFilter(std::string& out) : out_(out) {}
+
+    /**
+     * @brief Appends the visible part of a chunk to the output.
+     */
+    void feed(std::string_view chunk) {
+        if (depth_ > 0) ++thinking_chunks_;
+        pending_ += chunk;
+        size_t i = 0;
+        while (i < pending_.size()) {
+            size_t lt = pending_.find('<', i);
+            if (lt == std::string::npos) {
+                if (depth_ == 0) out_.append(pending_, i);
+                i = pending_.size();
+                break;
+            }
+            if (depth_ == 0) out_.append(pending_, i, lt - i);
+            std::string_view rest(pending_.data() + lt, pending_.size() - lt);
+            if (rest.substr(0, 7) == "<think>") {
+                ++depth_;
+                i = lt + 7;
+            } else if (rest.substr(0, 8) == "</think>") {
+                if (depth_ > 0) --depth_;
+                i = lt + 8;
+            } else if (could_become(rest, "<think>") || could_become(rest, "</think>")) {
+                i = lt; // Wait for the rest of the tag
+                break;
+            } else {
+                if (depth_ == 0) out_ += '<';
+                i = lt + 1;
+            }
+        }
+        pending_.erase(0, i);
+    }
+
+    /**
+     * @brief Flushes held-back text at the end of the stream; an unterminated span is dropped.
+     */
+    void finish() {
+        if (depth_ == 0) out_ += pending_;
+        pending_.clear();
+    }
+
+    /** @brief Stream chunks (roughly tokens) received inside reasoning spans so far. */
+    size_t thinking_chunks() const { return thinking_chunks_; }
+
+private:
+    static bool could_become(std::string_view fragment, std::string_view tag) {
+        return fragment.size() < tag.size() && tag.substr(0, fragment.size()) == fragment;
+    }
+
+    std::string& out_;
+    std::string pending_;
+    int depth_ = 0;
+    size_t thinking_chunks_ = 0;
+};
+
+/**
+ * @brief Outcome of a streamed generate request.
+ */
+enum class GenerateStatus { OK, FAILED, THINK_UNSUPPORTED, THINK_BUDGET };
+
+/**
+ * @brief Streams an Ollama /api/generate request, keeping only the visible answer.
+ *
+ * Each NDJSON line is handled as it arrives: `response` text goes through a
+ * ThinkFilter, and reasoning delivered either inline or in the separate
+ * `thinking` field counts against the budget. Exceeding the budget aborts the
+ * transfer so the caller can retry without paying for the rest of the reasoning.
+ * @param cli The HTTP client.
+ * @param payload The request body; `stream` should be true.
+ * @param think_budget Maximum reasoning tokens before aborting; 0 for no limit.
+ * @param response Receives the visible response text.
+ * @param error Receives a description of a failure.
+ * @param context If not null, receives the `context` token array of the final line.
+ * @return The outcome.
+ */
+GenerateStatus stream_generate(httplib::Client& cli, const nlohmann::json& payload, size_t think_budget,
+                               std::string& response, std::string& error, nlohmann::json* context = nullptr) {
+    response.clear();
+    ThinkFilter filter(response);
+    std::string pending;        // Incomplete NDJSON line
+    std::string error_body;     // Error message or raw body of a failed request
+    size_t thinking_tokens = 0; // Tokens in the separate `thinking` field
+    bool over_budget = false;
+
+    httplib::Request req;
+    req.method = "POST";
+    req.path = "/api/generate";
+    req.body = payload.dump();
+    req.set_header("Content-Type", "application/json");
+    req.content_receiver = [&](const char* data, size_t len, uint64_t, uint64_t) {
+        pending.append(data, len);
+        size_t start = 0, newline;
+        while ((newline = pending.find('\n', start)) != std::string::npos) {
+            std::string_view line(pending.data() + start, newline - start);
+            start = newline + 1;
+            if (line.empty()) continue;
+            auto j = nlohmann::json::parse(line, nullptr, false);
+            if (j.is_discarded() || !j.is_object()) {
+                error_body.append(line);
+                continue;
+            }
+            if (j.contains("error") && j["error"].is_string()) error_body = j["error"].get<std::string>();
+            if (j.contains("thinking") && j["thinking"].is_string() && !j["thinking"].get_ref<const std::string&>().empty()) ++thinking_tokens;
+            if (j.contains("response") && j["response"].is_string()) filter.feed(j["response"].get_ref<const std::string&>());
+            if (context && j.contains("context") && j["context"].is_array()) *context = std::move(j["context"]);
+            if (think_budget > 0 && thinking_tokens + filter.thinking_chunks() > think_budget) {
+                over_budget = true;
+                return false;
+            }
+        }
+        pending.erase(0, start);
+        return true;
+    };
+
+    auto res = cli.send(req);
+    if (over_budget) return GenerateStatus::THINK_BUDGET;
+    if (!res) {
+        error = "Status 0, Body: " + httplib::to_string(res.error());
+        return GenerateStatus::FAILED;
+    }
+    if (res->status != 200) {
+        if (error_body.empty()) error_body = res->body + pending;
+        error = "Status " + std::to_string(res->status) + ", Body: " + error_body;
+        // Servers or models without the think option reject it; the caller retries without it
+        if (res->status == 400 && error_body.find("think") != std::string::npos) return GenerateStatus::THINK_UNSUPPORTED;
+        return GenerateStatus::FAILED;
+    }
+    filter.finish();
+    return GenerateStatus::OK;
+}
+
 /**
  * @brief Enhances input data using an AI model via the Ollama service.
  * @param prompt The prompt to send to the AI model.
  * @param url The Ollama service URL.
- * @param models JSON object containing available models.
+ * @param model The name of the model to use.
  * @param terminal_width The width of the terminal in characters.
+ * @param think_budget Reasoning tokens allowed before re-requesting with thinking off; 0 for no limit.
+ * @param context If not null, the conversation so far (Ollama `context` tokens) is sent along and
+ *                replaced by the updated one, so a follow-up only pays for its own new tokens.
  * @return The AI-enhanced response or an error message.
  */
-std::string enhance_with_ai(const std::string& prompt, const std::string& url, const nlohmann::json& models, int terminal_width) {
+std::string enhance_with_ai(const std::string& prompt, const std::string& url, const std::string& model, int terminal_width,
+                            size_t think_budget = 0, nlohmann::json* context = nullptr) {
     httplib::Client cli(url);
+    cli.set_read_timeout(300); // Prefill of a large prompt can take a while before the first token
     
-    // Select the first available model from the models list
-    std::string model_name;
-    if (models.contains("models") && models["models"].is_array() && !models["models"].empty()) {
-        model_name = models["models"][0]["name"].get<std::string>();
-    } else {
+    if (model.empty()) {
         std::cerr << "\033[31mNo models available in the Ollama service\033[0m" << std::endl;
         return "Error: No models available";
     }
 
     // Prepare the payload for the AI request, including terminal width
     nlohmann::json payload = {
-        {"model", model_name},
+        {"model", model},
         {"prompt", prompt + "\n\nThe terminal width is " + std::to_string(terminal_width) + " characters. Ensure the output is formatted to fit within this width for symmetry and readability."},
-        {"stream", false}
+        {"stream", true},
+        {"think", false} // Skip reasoning on thinking models (qwen3, deepseek-r1); they answer severalfold faster
     };
+    if (context && context->is_array() && !context->empty()) payload["context"] = *context;
 
-    // Send the request to the Ollama service
-    auto res = cli.Post("/api/generate", payload.dump(), "application/json");
-    if (!res || res->status != 200) {
-        std::cerr << "\033[31mHTTP request failed: Status " << (res ? res->status : 0) << ", Body: " << (res ? res->body : "No response") << "\033[0m" << std::endl;
+    // Stream the response, dropping reasoning spans as they arrive
+    std::string response, error;
+    GenerateStatus status = stream_generate(cli, payload, think_budget, response, error, context);
+    if (status == GenerateStatus::THINK_UNSUPPORTED) {
+        payload.erase("think");
+        status = stream_generate(cli, payload, think_budget, response, error, context);
+    }
+    if (status == GenerateStatus::THINK_BUDGET) {
+        // The model reasons anyway: ask again with the qwen-style soft switch and no budget
+        std::cerr << "\033[33mModel exceeded the thinking budget of " << think_budget << " tokens; retrying with thinking disabled\033[0m" << std::endl;
+        payload["prompt"] = "/no_think " + payload["prompt"].get<std::string>();
+        status = stream_generate(cli, payload, 0, response, error, context);
+    }
+    if (status != GenerateStatus::OK) {
+        std::cerr << "\033[31mHTTP request failed: " << error << "\033[0m" << std::endl;
         return "Error: AI server issue";
     }
 
-    try {
-        // Parse the AI response
-        auto json_res = nlohmann::json::parse(res->body);
-        if (!json_res.contains("response")) {
-            std::cerr << "\033[31mAI response missing 'response' field: " << res->body << "\033[0m" << std::endl;
-            return "Error: No 'response' in AI output";
-        }
-
-        // Process the AI response
-        std::string response = json_res["response"].get<std::string>();
-        // Remove <think> tags and their contents
-        std::regex think_regex("<think>[^<]*</think>", std::regex::multiline);
-        response = std::regex_replace(response, think_regex, "");
-        response = unescape_string(response);
-
-        // Remove trailing notes
-        std::regex note_regex("\n*Note:.*$", std::regex::multiline);
-        response = std::regex_replace(response, note_regex, "");
-
-        // Remove triple backticks and their contents (including language specifiers and edge cases)
-        std::regex backtick_regex("```[a-zA-Z0-9]*\\n?[^`]*?```", std::regex::multiline);
-        response = std::regex_replace(response, backtick_regex, "");
-        // Remove standalone, partial, or empty backticks
-        std::regex standalone_backtick_regex("```[a-zA-Z0-9]*\\n?|\\n?```", std::regex::multiline);
-        response = std::regex_replace(response, standalone_backtick_regex, "");
-
-        // Apply ANSI formatting for bold text
-        std::regex bold_regex("\\*\\*([^\\*]+)\\*\\*");
-        response = std::regex_replace(response, bold_regex, "\033[1m$1\033[0m");
-
-        // Apply ANSI color formatting for colored bold text
-        std::map<std::string, std::string> color_codes = {
-            {"red", "\033[31m"},
-            {"green", "\033[32m"},
-            {"yellow", "\033[33m"},
-            {"blue", "\033[34m"}
-        };
-        for (const auto& [color, code] : color_codes) {
-            // Corrected regex: matches color[**text**] (e.g., yellow[**All Clear!**])
-            std::regex color_bold_regex(color + "\\$$   \\*\\*([^\\*]+)\\*\\*\\   $$", std::regex::multiline);
-            response = std::regex_replace(response, color_bold_regex, code + "\033[1m$1\033[0m");
-        }
-
-        // Clean up table formatting
-        std::regex table_border_regex("\\|_+\\|");
-        response = std::regex_replace(response, table_border_regex, "");
-        std::regex table_header_regex("\\|[- ]+\\|[- ]+\\|");
-        response = std::regex_replace(response, table_header_regex, "");
-        std::regex table_row_start("\\| ");
-        response = std::regex_replace(response, table_row_start, "");
-        std::regex table_row_end(" \\|");
-        response = std::regex_replace(response, table_row_end, "");
-        std::regex table_cell_divider(" \\| ");
-        response = std::regex_replace(response, table_cell_divider, "  ");
-
-        // Trim leading/trailing whitespace
-        response.erase(0, response.find_first_not_of(" \n\r\t"));
-        response.erase(response.find_last_not_of(" \n\r\t") + 1);
+    // Process the AI response
+    response = unescape_string(response);
+
+    // Remove trailing notes
+    std::regex note_regex("\n*Note:.*$", std::regex::multiline);
+    response = std::regex_replace(response, note_regex, "");
+
+    // Remove triple backticks and their contents (including language specifiers and edge cases)
+    std::regex backtick_regex("```[a-zA-Z0-9]*\\n?[^`]*?```", std::regex::multiline);
+    response = std::regex_replace(response, backtick_regex, "");
+    // Remove standalone, partial, or empty backticks
+    std::regex standalone_backtick_regex("```[a-zA-Z0-9]*\\n?|\\n?```", std::regex::multiline);
+    response = std::regex_replace(response, standalone_backtick_regex, "");
+
+    // Apply ANSI formatting for bold text
+    std::regex bold_regex("\\*\\*([^\\*]+)\\*\\*");
+    response = std::regex_replace(response, bold_regex, "\033[1m$1\033[0m");
+
+    // Apply ANSI color formatting for colored bold text
+    std::map<std::string, std::string> color_codes = {
+        {"red", "\033[31m"},
+        {"green", "\033[32m"},
+        {"yellow", "\033[33m"},
+        {"blue", "\033[34m"}
+    };
+    for (const auto& [color, code] : color_codes) {
+        // Corrected regex: matches color[**text**] (e.g., yellow[**All Clear!**])
+        std::regex color_bold_regex(color + "\\$$   \\*\\*([^\\*]+)\\*\\*\\   $$", std::regex::multiline);
+        response = std::regex_replace(response, color_bold_regex, code + "\033[1m$1\033[0m");
+    }
+
+    // Clean up table formatting
+    std::regex table_border_regex("\\|_+\\|");
+    response = std::regex_replace(response, table_border_regex, "");
+    std::regex table_header_regex("\\|[- ]+\\|[- ]+\\|");
+    response = std::regex_replace(response, table_header_regex, "");
+    std::regex table_row_start("\\| ");
+    response = std::regex_replace(response, table_row_start, "");
+    std::regex table_row_end(" \\|");
+    response = std::regex_replace(response, table_row_end, "");
+    std::regex table_cell_divider(" \\| ");
+    response = std::regex_replace(response, table_cell_divider, "  ");
+
+    // Trim leading/trailing whitespace
+    response.erase(0, response.find_first_not_of(" \n\r\t"));
+    response.erase(response.find_last_not_of(" \n\r\t") + 1);
+
+    return response;
+}
+
+/**
+ * @brief The models a request may be routed to.
+ */
+struct ModelCascade {
+    std::string small; // Fast first-pass model
+    std::string large; // Escalation model; equal to small when there is nothing to escalate to
+};
+
+/**
+ * @brief Picks the smallest and largest installed generation models from /api/tags.
+ * @param models JSON object containing available models.
+ * @param pinned A model requested with --model; used for both roles if not empty.
+ * @return The cascade; both names are empty if no model is installed.
+ */
+ModelCascade plan_models(const nlohmann::json& models, const std::string& pinned) {
+    if (!pinned.empty()) return {pinned, pinned};
+    ModelCascade cascade;
+    if (!models.contains("models") || !models["models"].is_array()) return cascade;
+    uint64_t smallest = UINT64_MAX, largest = 0;
+    for (const auto& m : models["models"]) {
+        if (!m.contains("name") || !m["name"].is_string()) continue;
+        const std::string& name = m["name"].get_ref<const std::string&>();
+        // Embedding models cannot generate text
+        std::string family = m.contains("details") && m["details"].is_object() ? m["details"].value("family", "") : "";
+        if (name.find("embed") != std::string::npos || family.find("bert") != std::string::npos) continue;
+        uint64_t size = m.contains("size") && m["size"].is_number_unsigned() ? m["size"].get<uint64_t>() : 0;
+        if (cascade.small.empty() || size < smallest) {
+            smallest = size;
+            cascade.small = name;
+        }
+        if (cascade.large.empty() || size > largest) {
+            largest = size;
+            cascade.large = name;
+        }
+    }
+    return cascade;
+}
+
+/**
+ * @brief Local estimate of how hard an input is to analyze, from 0 (trivial) to 1 (hard).
+ *
+ * Combines input size, the share of lines mentioning failures and the input
+ * format, so large or error-laden inputs skip the small model entirely.
+ * @param input The (ANSI-stripped) input.
+ * @param format The detected format.
+ * @return The complexity score.
+ */
+double input_complexity(std::string_view input, Format format) {
+    static const std::array<std::string_view, 12> keywords = {
+        "error", "fail", "fatal", "panic", "exception", "denied", "refused",
+        "timeout", "crash", "backoff", "oom", "killed"};
+    size_t lines = 0, flagged = 0;
+    std::string lower;
+    for (size_t pos = 0; pos < input.size();) {
+        size_t end = input.find('\n', pos);
+        if (end == std::string_view::npos) end = input.size();
+        std::string_view line = input.substr(pos, std::min<size_t>(end - pos, 512));
+        pos = end + 1;
+        ++lines;
+        lower.assign(line);
+        for (char& c : lower) c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+        for (std::string_view k : keywords) {
+            if (lower.find(k) != std::string::npos) {
+                ++flagged;
+                break;
+            }
+        }
+    }
+    double size = input.size() <= 4096 ? 0.0 : std::min(1.0, std::log2(input.size() / 4096.0) / 6.0); // 4 KiB → 0, 256 KiB → 1
+    double errors = lines ? std::min(1.0, 10.0 * flagged / lines) : 0.0;                               // 10% error lines → 1
+    double shape = format == Format::PLAIN_TEXT ? 0.2 : format == Format::TABLE ? 0.0 : 0.1;
+    return std::min(1.0, 0.5 * size + 0.4 * errors + shape);
+}
 
+/**
+ * @brief Runs a prompt through the model cascade.
+ *
+ * Inputs below the complexity threshold go to the small model, which is asked
+ * to flag uncertain answers with `[confidence: low]`; flagged answers and
+ * complex inputs are answered by the large model.
+ * @param prompt The prompt to send.
+ * @param url The Ollama service URL.
+ * @param cascade The small and large models.
+ * @param complexity Score from input_complexity().
+ * @param terminal_width The width of the terminal in characters.
+ * @param think_budget Reasoning tokens allowed before re-requesting with thinking off; 0 for no limit.
+ * @param context If not null, receives the conversation context of the answering model.
+ * @param model Receives the name of the model whose answer is returned.
+ * @return The response, without confidence markers.
+ */
+std::string enhance_with_cascade(const std::string& prompt, const std::string& url, const ModelCascade& cascade, double complexity,
+                                 int terminal_width, size_t think_budget, nlohmann::json* context, std::string& model) {
+    const double escalate_above = 0.6;
+    auto strip_marker = [](std::string response) {
+        size_t at = response.find("[confidence:");
+        if (at == std::string::npos) at = response.find("[Confidence:");
+        if (at != std::string::npos) {
+            size_t end = response.find(']', at);
+            response.erase(at, end == std::string::npos ? std::string::npos : end + 1 - at);
+            response.erase(response.find_last_not_of(" \n\r\t") + 1);
+        }
         return response;
-    } catch (const nlohmann::json::exception& e) {
-        std::cerr << "\033[31mJSON parsing error: " << e.what() << ", Body: " << res->body << "\033[0m" << std::endl;
-        return "Error: Invalid AI response";
+    };
+
+    if (cascade.small != cascade.large && complexity < escalate_above) {
+        model = cascade.small;
+        std::string response = enhance_with_ai(prompt + "\n\nIf you are not confident that your analysis is correct and complete, end your answer with the exact line [confidence: low]. Otherwise end it with [confidence: high].",
+                                               url, model, terminal_width, think_budget, context);
+        std::string lower = response;
+        for (char& c : lower) c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+        if (lower.find("[confidence: low]") == std::string::npos && lower.rfind("error:", 0) != 0) return strip_marker(response);
+        std::cerr << "\033[2mEscalating from " << cascade.small << " to " << cascade.large << "\033[0m" << std::endl;
+        if (context) *context = nlohmann::json();
     }
+    model = cascade.large;
+    return strip_marker(enhance_with_ai(prompt, url, model, terminal_width, think_budget, context));
 }
 
 /**
- * @brief Main program entry point.
- * @param argc Number of command-line arguments.
- * @param argv Array of command-line arguments.
- * @return Exit status (0 for success, 1 for failure).
+ * @brief Small thread pool that resumes coroutines.
+ *
+ * Pipeline stages co_await schedule() to hop onto a worker, so blocking
+ * work (stdin, the Ollama HTTP calls) and CPU work overlap on a fixed,
+ * small number of threads instead of one thread per concern.
  */
-int main(int argc, char* argv[]) {
-    bool use_colors = true; // Enable color output by default
-    std::string url = "http://localhost:11434"; // Default URL
-    int terminal_width = get_terminal_width(); // Get terminal width
+class Executor {
+public:
+    explicit Executor(size_t threads) {
+        for (size_t i = 0; i < threads; ++i) {
+            workers_.emplace_back([this]() {
+                while (true) {
+                    std::coroutine_handle<> handle;
+                    {
+                        std::unique_lock<std::mutex> lock(mutex_);
+                        cv_.wait(lock, [&] { return stopping_ || !queue_.empty(); });
+                        if (queue_.empty()) return;
+                        handle = queue_.front();
+                        queue_.pop_front();
+                    }
+                    handle.resume();
+                }
+            });
+        }
+    }
 
-    // Check for --help or -h
-    for (int i = 1; i < argc; ++i) {
-        std::string arg = argv[i];
-        if (arg == "--help" || arg == "-h") {
-            display_help();
-            return 0;
+    ~Executor() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
         }
+        cv_.notify_all();
+        for (auto& w : workers_) w.join();
     }
 
-    // Retrieve URL from config or arguments
-    url = get_url(argc, argv);
+    Executor(const Executor&) = delete;
+    Executor& operator=(const Executor&) = delete;
+
+    /**
+     * @brief Queues a suspended coroutine to be resumed on a worker.
+     */
+    void post(std::coroutine_handle<> handle) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            queue_.push_back(handle);
+        }
+        cv_.notify_one();
+    }
+
+    /**
+     * @brief Awaitable that continues the awaiting coroutine on a worker thread.
+     */
+    auto schedule() {
+        struct Awaiter {
+            Executor& executor;
+            bool await_ready() const noexcept { return false; }
+            void await_suspend(std::coroutine_handle<> handle) { executor.post(handle); }
+            void await_resume() const noexcept {}
+        };
+        return Awaiter{*this};
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<std::coroutine_handle<>> queue_;
+    std::vector<std::thread> workers_;
+    bool stopping_ = false;
+};
+
+/**
+ * @brief Lazily started coroutine producing a T.
+ *
+ * Starts when awaited and resumes its awaiter on completion (symmetric
+ * transfer); exceptions propagate to the awaiter.
+ */
+template <typename T>
+class Task {
+public:
+    struct promise_type {
+        std::optional<T> value;
+        std::exception_ptr error;
+        std::coroutine_handle<> continuation = std::noop_coroutine();
+
+        Task get_return_object() { return Task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        auto final_suspend() noexcept {
+            struct Final {
+                bool await_ready() const noexcept { return false; }
+                std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> h) noexcept { return h.promise().continuation; }
+                void await_resume() const noexcept {}
+            };
+            return Final{};
+        }
+        template <typename U>
+        void return_value(U&& v) { value.emplace(std::forward<U>(v)); }
+        void unhandled_exception() { error = std::current_exception(); }
+    };
+
+    explicit Task(std::coroutine_handle<promise_type> handle) : handle_(handle) {}
+    Task(Task&& other) noexcept : handle_(std::exchange(other.handle_, {})) {}
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+    ~Task() {
+        if (handle_) handle_.destroy();
+    }
+
+    auto operator co_await() && {
+        struct Awaiter {
+            std::coroutine_handle<promise_type> handle;
+            bool await_ready() const noexcept { return false; }
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+                handle.promise().continuation = awaiting;
+                return handle;
+            }
+            T await_resume() {
+                if (handle.promise().error) std::rethrow_exception(handle.promise().error);
+                return std::move(*handle.promise().value);
+            }
+        };
+        return Awaiter{handle_};
+    }
+
+private:
+    std::coroutine_handle<promise_type> handle_;
+};
+
+/**
+ * @brief Result slot of a task started with spawn(); awaitable once, or waitable from a plain thread.
+ */
+template <typename T>
+class Spawned {
+public:
+    struct State {
+        std::mutex mutex;
+        std::condition_variable cv;
+        std::optional<T> value;
+        std::exception_ptr error;
+        std::coroutine_handle<> waiter;
+        bool done = false;
+    };
+
+    explicit Spawned(std::shared_ptr<State> state) : state_(std::move(state)) {}
+
+    auto operator co_await() {
+        struct Awaiter {
+            std::shared_ptr<State> state;
+            bool await_ready() const noexcept { return false; }
+            bool await_suspend(std::coroutine_handle<> awaiting) {
+                std::lock_guard<std::mutex> lock(state->mutex);
+                if (state->done) return false;
+                state->waiter = awaiting;
+                return true;
+            }
+            T await_resume() {
+                if (state->error) std::rethrow_exception(state->error);
+                return std::move(*state->value);
+            }
+        };
+        return Awaiter{state_};
+    }
+
+    /**
+     * @brief Blocks the calling (non-executor) thread until the task finishes.
+     */
+    T wait() {
+        std::unique_lock<std::mutex> lock(state_->mutex);
+        state_->cv.wait(lock, [&] { return state_->done; });
+        if (state_->error) std::rethrow_exception(state_->error);
+        return std::move(*state_->value);
+    }
+
+private:
+    std::shared_ptr<State> state_;
+};
+
+/**
+ * @brief Fire-and-forget coroutine that frees itself when it finishes.
+ */
+struct Detached {
+    struct promise_type {
+        Detached get_return_object() { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+
+/**
+ * @brief Drives a task on the executor and publishes its result to state.
+ */
+template <typename T>
+Detached drive(Executor& executor, Task<T> task, std::shared_ptr<typename Spawned<T>::State> state) {
+    co_await executor.schedule();
+    std::optional<T> value;
+    std::exception_ptr error;
+    try {
+        value.emplace(co_await std::move(task));
+    } catch (...) {
+        error = std::current_exception();
+    }
+    std::coroutine_handle<> waiter;
+    {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        state->value = std::move(value);
+        state->error = error;
+        state->done = true;
+        waiter = state->waiter;
+        state->cv.notify_all();
+    }
+    if (waiter) executor.post(waiter);
+}
+
+/**
+ * @brief Starts a task on the executor now; its result is awaited (or waited for) later.
+ */
+template <typename T>
+Spawned<T> spawn(Executor& executor, Task<T> task) {
+    auto state = std::make_shared<typename Spawned<T>::State>();
+    drive(executor, std::move(task), state);
+    return Spawned<T>(state);
+}
+
+/**
+ * @brief Wraps a callable as a task that runs it on an executor worker.
+ */
+template <typename F>
+Task<std::invoke_result_t<F>> offload(Executor& executor, F fn) {
+    co_await executor.schedule();
+    co_return fn();
+}
+
+/**
+ * @brief Per-run options collected from the command line.
+ */
+struct RunOptions {
+    std::string url;
+    int terminal_width = 80;
+    std::string select_expr;
+    std::vector<PathSegment> select_path;
+    size_t think_budget = 0;
+    bool interactive = false;
+    std::string model; // Pinned with --model; empty to use the cascade
+    bool ai = false;   // Ask the model even when a local analyzer recognized the output
+    TableOptions table; // Table rendering and reduction (--normalize-units)
+};
+
+/**
+ * @brief Answers follow-up questions about the analyzed input until EOF or "exit".
+ *
+ * Questions are read from /dev/tty because stdin carried the input. Each
+ * request continues the conversation from the returned Ollama `context`, so
+ * the input is not re-sent or re-prefilled.
+ * @param options Per-run options.
+ * @param model The model that gave the first answer; the context belongs to it.
+ * @param context The conversation context after the first answer; updated per answer.
+ */
+void follow_up(const RunOptions& options, const std::string& model, nlohmann::json& context) {
+    std::ifstream tty("/dev/tty");
+    if (!tty) {
+        std::cerr << "\033[33mNo terminal available for follow-up questions\033[0m" << std::endl;
+        return;
+    }
+    if (!context.is_array() || context.empty()) {
+        std::cerr << "\033[33mThe model returned no conversation context; follow-ups are unavailable\033[0m" << std::endl;
+        return;
+    }
+    std::string question;
+    while (true) {
+        std::cerr << "\n\033[1;34m❯\033[0m " << std::flush;
+        if (!std::getline(tty, question)) break;
+        question.erase(0, question.find_first_not_of(" \t"));
+        question.erase(question.find_last_not_of(" \t\r") + 1);
+        if (question.empty()) continue;
+        if (question == "exit" || question == "quit") break;
+        std::string prompt = "Answer this follow-up question about the same data, directly and concisely (do NOT restate the summary). Use ANSI escape codes for emphasis; no markdown. Question: " + question;
+        std::string answer = enhance_with_ai(prompt, options.url, model, options.terminal_width, options.think_budget, &context);
+        write_output(STDOUT_FILENO, answer + "\n");
+    }
+    std::cerr << std::endl;
+}
+
+/**
+ * @brief What earlier stages learned about the input, shared with every later stage.
+ */
+struct RunContext {
+    Fingerprint source;                // Command that produced the input, from fingerprint_command()
+    Format format = Format::PLAIN_TEXT; // Detected input format
+};
+
+/**
+ * @brief The eo pipeline: ingest → detect → format → reduce → request → render (→ follow-up with -i).
+ *
+ * The service check runs concurrently with ingestion, and the local
+ * rendering (format) runs concurrently with building the prompt data
+ * (reduce), so the slowest of each pair bounds the wall time.
+ * @param executor The executor the stages run on.
+ * @param options Per-run options.
+ * @return Exit status (0 for success, 1 for failure).
+ */
+Task<int> run_pipeline(Executor& executor, const RunOptions& options) {
+    const int terminal_width = options.terminal_width;
+    const std::string& select_expr = options.select_expr;
+    const std::vector<PathSegment>& select_path = options.select_path;
+
+    // Verify Ollama service is running while stdin is being read; only fatal once the model is needed
     nlohmann::json models;
+    std::string service_error;
+    auto service = spawn(executor, offload(executor, [&]() { return check_service(options.url, models, service_error); }));
 
-    // Verify Ollama service is running
-    if (!check_service(url, models)) {
-        return 1;
+    // Ingest: read (and decompress) input
+    std::string input;
+    std::string read_error;
+    try {
+        input = co_await offload(executor, []() { return read_input(); });
+    } catch (const std::exception& e) {
+        read_error = e.what();
+    }
+    bool service_ok = co_await service;
+    if (!read_error.empty()) {
+        std::cerr << "\033[31m" << read_error << "\033[0m" << std::endl;
+        co_return 1;
     }
 
-    // Read and process input
-    std::string input = read_input();
+    // Binary input (core dumps, archives, images) gets a local summary instead of a parse and a prompt
+    if (looks_binary(input)) {
+        write_output(STDOUT_FILENO, format_binary(input, terminal_width) + "\n");
+        co_return 0;
+    }
+
+    // Repair invalid UTF-8 up front so binary-tainted input can always be serialized into the request
+    repair_utf8(input);
+
+    // Strip ANSI escapes so they do not skew detection, widths or the prompt; keep colors for local rendering
+    std::vector<AnsiSpan> input_colors;
+    strip_ansi(input, &input_colors);
     if (input.empty()) {
         std::cout << "No input provided." << std::endl;
-        return 0;
+        co_return 0;
+    }
+
+    // Per-stage arenas: parse and format containers are bump-allocated and released together.
+    // The format and reduce stages run concurrently, so each gets its own.
+    std::pmr::monotonic_buffer_resource arena(std::max<size_t>(64 * 1024, input.size() / 4));
+    std::pmr::monotonic_buffer_resource reduce_arena(64 * 1024);
+
+    // Detect: which command produced the input, and its format
+    RunContext run;
+    run.source = fingerprint_command(input);
+    std::vector<YamlDocument> docs;
+    run.format = detect_format(input, &arena, run.source.command == Command::PS, &docs); // COMMAND/CMD holds spaces
+    if (run.format == Format::TABLE && !std::isnan(parse_log_timestamp(std::string_view(input).substr(0, input.find('\n'))))) {
+        // Log lines with a fixed number of fields look like a table, but a table header never starts with a timestamp
+        run.format = Format::PLAIN_TEXT;
+    }
+    const Format format = run.format;
+
+    if (!select_expr.empty() && format != Format::JSON && format != Format::YAML) {
+        std::cerr << "\033[33m--select applies to JSON and YAML input only; ignoring it\033[0m" << std::endl;
+    }
+    if ((!options.table.sort.empty() || options.table.top > 0 || !options.table.group_by.empty()) && format != Format::TABLE) {
+        std::cerr << "\033[33m--group-by, --sort and --top apply to tables only; ignoring them\033[0m" << std::endl;
+    }
+
+    // Well-known command output gets deterministic local findings; the model becomes optional
+    const LocalAnalyzer* analyzer = select_expr.empty() ? match_analyzer(input, run.source, &arena) : nullptr;
+    std::vector<Finding> checks;
+    std::string findings;
+    if (analyzer) {
+        checks = analyzer->analyze(split_command_output(input, *analyzer, &arena));
+        findings = format_findings(*analyzer, checks);
     }
 
-    // Detect input format and prepare output
-    Format format = detect_format(input);
+    // Format (local rendering) and reduce (prompt data) run side by side
     std::string formatted_output;
     std::string ai_prompt;
-
-    // Handle input based on detected format
-    if (format == Format::JSON) {
-        formatted_output = format_json(input, terminal_width);
-        ai_prompt = "Act as a data analyst !(do NOT talk to me; ej:'Here's your....). Transform the provided JSON data into a highly readable and visually appealing format suitable for a terminal, summarizing the information and removing unnecessary data. Use ANSI escape codes according to your criteria in the output for formatting (e.g., \\033[31m for red, \\033[32m for green, \\033[33m for yellow, \\033[34m for blue, \\033[1m for bold, \\033[0m to reset). For text wrapped in ** (e.g., **something**), apply bold formatting. For text prefixed with a color name followed by [**text**] (e.g., yellow[**All Clear!**]), apply the specified color and bold formatting. Supported colors are red (\\033[31m), green (\\033[32m), yellow (\\033[33m), blue (\\033[34m). Use icons (e.g., ★, ►, ✔) or emojis for clarity. Do not use markdown code blocks or any markdown formatting; output plain text with ANSI codes only !(Do NOT give icon legends). At the end, append a concise analysis of the data, including key points, patterns, trends, or notable observations, and provide the AI's opinions or interpretations of the data's implications. The terminal width is " + std::to_string(terminal_width) + " characters. Ensure the output is formatted to fit within this width for symmetry and readability. Here's the data:\n\n" + input;
+    if (format == Format::JSON || format == Format::YAML) {
+        // JSON is summarized from the compact tape; YAML documents from their DOM
+        std::string data;
+        std::string kind = format == Format::JSON ? "JSON" : "YAML (shown converted to JSON)";
+        if (format == Format::JSON) {
+            if (!select_expr.empty()) {
+                // Cut the selection out of the raw text; unselected subtrees are never parsed
+                try {
+                    input = select_json(input, select_path);
+                } catch (const std::exception& e) {
+                    std::cerr << "\033[31mSelection failed: " << e.what() << "\033[0m" << std::endl;
+                    co_return 1;
+                }
+            }
+            auto reduce = spawn(executor, offload(executor, [&]() {
+                return summarize_json(JsonTape::parse_parallel(input, static_cast<unsigned>(Scheduler::global().jobs()), &reduce_arena));
+            }));
+            formatted_output = format_json(input, terminal_width);
+            data = co_await reduce;
+        } else {
+            if (!select_expr.empty()) {
+                std::vector<YamlDocument> selected;
+                for (const auto& d : docs) select_dom(d, select_path, 0, selected);
+                if (selects_many(select_path)) docs = {YamlDocument(selected)};
+                else docs = selected.empty() ? std::vector<YamlDocument>{nullptr} : selected;
+            }
+            auto reduce = spawn(executor, offload(executor, [&]() {
+                return summarize_json(docs.size() == 1 ? docs[0] : YamlDocument(docs));
+            }));
+            formatted_output = format_yaml(docs);
+            data = co_await reduce;
+        }
+        ai_prompt = "Act as a data analyst !(do NOT talk to me; ej:'Here's your....). Transform the provided " + kind + " data into a highly readable and visually appealing format suitable for a terminal, summarizing the information and removing unnecessary data. Use ANSI escape codes according to your criteria in the output for formatting (e.g., \\033[31m for red, \\033[32m for green, \\033[33m for yellow, \\033[34m for blue, \\033[1m for bold, \\033[0m to reset). For text wrapped in ** (e.g., **something**), apply bold formatting. For text prefixed with a color name followed by [**text**] (e.g., yellow[**All Clear!**]), apply the specified color and bold formatting. Supported colors are red (\\033[31m), green (\\033[32m), yellow (\\033[33m), blue (\\033[34m). Use icons (e.g., ★, ►, ✔) or emojis for clarity. Do not use markdown code blocks or any markdown formatting; output plain text with ANSI codes only !(Do NOT give icon legends). At the end, append a concise analysis of the data, including key points, patterns, trends, or notable observations, and provide the AI's opinions or interpretations of the data's implications. The terminal width is " + std::to_string(terminal_width) + " characters. Ensure the output is formatted to fit within this width for symmetry and readability. Here's the data (compact JSON):\n\n" + data;
     } else if (format == Format::TABLE) {
-        formatted_output = format_table(input, terminal_width);
-        ai_prompt = "Act as a data analyst !(do NOT talk to me; ej:'Here's your....). Transform the provided table data into a highly readable and visually appealing format suitable for a terminal, summarizing the information and removing unnecessary data. Use ANSI escape codes according to your criteria in the output for formatting (e.g., \\033[31m for red, \\033[32m for green, \\033[33m for yellow, \\033[34m for blue, \\033[1m for bold, \\033[0m to reset). For text wrapped in ** (e.g., **something**), apply bold formatting. For text prefixed with a color name followed by [**text**] (e.g., yellow[**All Clear!**]), apply the specified color and bold formatting. Supported colors are red (\\033[31m), green (\\033[32m), yellow (\\033[33m), blue (\\033[34m). Use icons (e.g., ★, ►, ✔) or emojis for clarity. Do not use markdown code blocks or any markdown formatting; output plain text with ANSI codes only !(Do NOT give icon legends). At the end, append a concise analysis of the data, including key points, patterns, trends, or notable observations, and provide the AI's opinions or interpretations of the data's implications. The terminal width is " + std::to_string(terminal_width) + " characters. Ensure the output is formatted to fit within this width for symmetry and readability. Here's the data:\n\n" + input;
+        // Sort/top/normalize once; the rendering and the prompt share the result
+        TableData table{Table(&arena), std::pmr::vector<ColumnType>(&arena)};
+        try {
+            table = prepare_table(input, options.table, &arena);
+        } catch (const std::exception& e) {
+            std::cerr << "\033[31m" << e.what() << "\033[0m" << std::endl;
+            co_return 1;
+        }
+        // Large tables reach the model as locally computed aggregates instead of every row
+        bool aggregate = options.table.group_by.empty() && table.rows.size() > AUTO_AGGREGATE_ROWS + 1;
+        auto reduce = spawn(executor, offload(executor, [&]() {
+            return aggregate ? summarize_table(table, &reduce_arena) : minify_table(table);
+        }));
+        formatted_output = format_table(input, table, terminal_width, &input_colors, &arena);
+        ai_prompt = "Act as a data analyst !(do NOT talk to me; ej:'Here's your....). Transform the provided table data into a highly readable and visually appealing format suitable for a terminal, summarizing the information and removing unnecessary data. Use ANSI escape codes according to your criteria in the output for formatting (e.g., \\033[31m for red, \\033[32m for green, \\033[33m for yellow, \\033[34m for blue, \\033[1m for bold, \\033[0m to reset). For text wrapped in ** (e.g., **something**), apply bold formatting. For text prefixed with a color name followed by [**text**] (e.g., yellow[**All Clear!**]), apply the specified color and bold formatting. Supported colors are red (\\033[31m), green (\\033[32m), yellow (\\033[33m), blue (\\033[34m). Use icons (e.g., ★, ►, ✔) or emojis for clarity. Do not use markdown code blocks or any markdown formatting; output plain text with ANSI codes only !(Do NOT give icon legends). At the end, append a concise analysis of the data, including key points, patterns, trends, or notable observations, and provide the AI's opinions or interpretations of the data's implications. The terminal width is " + std::to_string(terminal_width) + " characters. Ensure the output is formatted to fit within this width for symmetry and readability. Here's the data (tab-separated):\n\n" + co_await reduce;
     } else {
+        // Logs: event and error rates per time bucket, rendered locally and handed to the model
+        auto timeline = build_timeline(input, static_cast<size_t>(std::clamp(terminal_width - 50, 12, 60)), &arena);
+        if (timeline) formatted_output = format_timeline(*timeline);
         ai_prompt = "Act as a command-line output enhancer !(do NOT talk to me; ej:'Here's your....). Transform the raw output from a command into a highly readable and visually appealing format suitable for a terminal, summarizing the information and removing unnecessary data. Use ANSI escape codes according to your criteria in the output for formatting (e.g., \\033[31m for red, \\033[32m for green, \\033[33m for yellow, \\033[34m for blue, \\033[1m for bold, \\033[0m to reset). For text wrapped in ** (e.g., **something**), apply bold formatting. For text prefixed with a color name followed by [**text**] (e.g., yellow[**All Clear!**]), apply the specified color and bold formatting. Supported colors are red (\\033[31m), green (\\033[32m), yellow (\\033[33m), blue (\\033[34m). Use icons (e.g., ★, ►, ✔) or emojis for clarity. Do not use markdown code blocks or any markdown formatting; output plain text with ANSI codes only !(Do NOT give icon legends). The terminal width is " + std::to_string(terminal_width) + " characters. Ensure the output is formatted to fit within this width for symmetry and readability. Here's the output to enhance:\n\n" + input;
+        if (timeline) ai_prompt += "\n\n" + timeline_prompt(*timeline);
+    }
+
+    if (analyzer && !options.ai) {
+        // Local findings only: no model round trip
+        if (!formatted_output.empty()) formatted_output += "\n\n";
+        formatted_output += findings;
+        formatted_output += '\n';
+        std::cout.flush();
+        write_output(STDOUT_FILENO, formatted_output);
+        co_return 0;
+    }
+    if (run.source.command != Command::UNKNOWN) {
+        ai_prompt += "\n\n(The data is the output of `" + std::string(run.source.name) + "`.)";
+    }
+    if (!service_ok) {
+        std::cerr << "\033[31m" << service_error << "\033[0m" << std::endl;
+        co_return 1;
+    }
+    if (analyzer) {
+        // Let the model build on the deterministic checks instead of redoing them
+        ai_prompt += "\n\nLocal checks of this " + std::string(analyzer->command) + " output already found:\n" + format_findings(*analyzer, checks, false);
     }
 
-    // Get AI-enhanced response
-    std::string ai_response = enhance_with_ai(ai_prompt, url, models, terminal_width);
+    // Request: get AI-enhanced response (keeping the conversation context for follow-ups),
+    // through the small/large model cascade
+    nlohmann::json context;
+    std::string answer_model;
+    ModelCascade cascade = plan_models(models, options.model);
+    double complexity = input_complexity(input, format);
+    std::string ai_response = co_await offload(executor, [&]() {
+        return enhance_with_cascade(ai_prompt, options.url, cascade, complexity, terminal_width, options.think_budget,
+                                    options.interactive ? &context : nullptr, answer_model);
+    });
 
-    // Output results based on format
-    if (format == Format::JSON || format == Format::TABLE) {
-        std::cout << formatted_output << "\n\n" << ai_response << std::endl;
+    // Render: output results based on format
+    std::cout.flush();
+    if (analyzer) {
+        if (!formatted_output.empty()) formatted_output += "\n\n";
+        formatted_output += findings;
+    }
+    if (format != Format::PLAIN_TEXT || !formatted_output.empty()) {
+        formatted_output += "\n\n";
+        formatted_output += ai_response;
+        formatted_output += '\n';
+        write_output(STDOUT_FILENO, formatted_output);
     } else {
-        std::cout << ai_response << std::endl;
+        write_output(STDOUT_FILENO, ai_response + "\n");
     }
 
-    return 0;
-}
\ No newline at end of file
+    // Follow-up: answer questions against the loaded context
+    if (options.interactive) {
+        co_await offload(executor, [&]() { follow_up(options, answer_model, context); return true; });
+    }
+
+    co_return 0;
+}
+
+/**
+ * @brief Main program entry point.
+ * @param argc Number of command-line arguments.
+ * @param argv Array of command-line arguments.
+ * @return Exit status (0 for success, 1 for failure).
+ */
+int main(int argc, char* argv[]) {
+    bool use_colors = true; // Enable color output by default
+    std::string url = "http://localhost:11434"; // Default URL
+    int terminal_width = get_terminal_width(); // Get terminal width
+
+    std::string select_expr; // jq-style path applied to JSON/YAML input
+    size_t jobs = 0; // CPU parallelism; 0 = available CPUs
+    size_t think_budget = 0; // Reasoning tokens allowed before re-requesting; 0 = unlimited
+    bool interactive = false; // Ask follow-up questions after the first answer
+    std::string model; // Pinned model; empty = small/large cascade
+    bool ai = false; // Also ask the model when a local analyzer handles the output
+    TableOptions table_options; // Table rendering and reduction options
+
+    // Check for --help or -h and per-run options
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--help" || arg == "-h") {
+            display_help();
+            return 0;
+        } else if (arg == "-i" || arg == "--interactive") {
+            interactive = true;
+        } else if (arg == "--ai") {
+            ai = true;
+        } else if (arg == "--normalize-units") {
+            table_options.normalize_units = true;
+        } else if (arg.find("--sort=") == 0) {
+            table_options.sort = arg.substr(7);
+            table_options.descending = !table_options.sort.empty() && table_options.sort[0] == '-';
+            if (table_options.descending) table_options.sort.erase(0, 1);
+            if (table_options.sort.empty()) {
+                std::cerr << "\033[31mInvalid --sort value: " << arg.substr(7) << "\033[0m" << std::endl;
+                return 1;
+            }
+        } else if (arg.find("--group-by=") == 0) {
+            table_options.group_by = arg.substr(11);
+        } else if (arg.find("--agg=") == 0) {
+            try {
+                table_options.aggregates = parse_aggregates(arg.substr(6));
+            } catch (const std::exception& e) {
+                std::cerr << "\033[31m" << e.what() << "\033[0m" << std::endl;
+                return 1;
+            }
+        } else if (arg.find("--top=") == 0) {
+            char* end = nullptr;
+            long value = std::strtol(arg.c_str() + 6, &end, 10);
+            if (end == arg.c_str() + 6 || *end != '\0' || value < 1) {
+                std::cerr << "\033[31mInvalid --top value: " << arg.substr(6) << "\033[0m" << std::endl;
+                return 1;
+            }
+            table_options.top = static_cast<size_t>(value);
+        } else if (arg.find("--model=") == 0) {
+            model = arg.substr(8);
+        } else if (arg.find("--select=") == 0) {
+            select_expr = arg.substr(9);
+        } else if (arg.find("--jobs=") == 0) {
+            char* end = nullptr;
+            long value = std::strtol(arg.c_str() + 7, &end, 10);
+            if (end == arg.c_str() + 7 || *end != '\0' || value < 1) {
+                std::cerr << "\033[31mInvalid --jobs value: " << arg.substr(7) << "\033[0m" << std::endl;
+                return 1;
+            }
+            jobs = static_cast<size_t>(value);
+        } else if (arg.find("--think-budget=") == 0) {
+            char* end = nullptr;
+            long value = std::strtol(arg.c_str() + 15, &end, 10);
+            if (end == arg.c_str() + 15 || *end != '\0' || value < 1) {
+                std::cerr << "\033[31mInvalid --think-budget value: " << arg.substr(15) << "\033[0m" << std::endl;
+                return 1;
+            }
+            think_budget = static_cast<size_t>(value);
+        }
+    }
+    if (!table_options.aggregates.empty() && table_options.group_by.empty()) {
+        std::cerr << "\033[31m--agg requires --group-by\033[0m" << std::endl;
+        return 1;
+    }
+    Scheduler::global(jobs); // Size the shared CPU pool before any stage uses it
+    std::vector<PathSegment> select_path;
+    if (!select_expr.empty()) {
+        try {
+            select_path = parse_select(select_expr);
+        } catch (const std::exception& e) {
+            std::cerr << "\033[31m" << e.what() << "\033[0m" << std::endl;
+            return 1;
+        }
+    }
+
+    // Retrieve URL from config or arguments
+    url = get_url(argc, argv);
+
+    RunOptions options;
+    options.url = url;
+    options.terminal_width = terminal_width;
+    options.select_expr = select_expr;
+    options.select_path = std::move(select_path);
+    options.think_budget = think_budget;
+    options.interactive = interactive;
+    options.model = model;
+    options.ai = ai;
+    options.table = table_options;
+
+    // Two workers: enough to overlap one blocking wait (stdin, HTTP) with CPU work; CPU-heavy stages fan out on the Scheduler
+    Executor executor(2);
+    return spawn(executor, run_pipeline(executor, options)).wait();
+}